@@ -0,0 +1,164 @@
+// Generated by sourceSettingsFiles/gbsTableCompiler (do not edit by hand)
+// Compressed program arrays, decompressed on the fly by PresetStream
+// 2 presets of 1440 registers in 559 bytes
+
+// 240p: 507 bytes
+const uint8_t programArray240p[] PROGMEM = {
+0, // base
+0, 143,
+66,
+14, 64, 16, 172, 27, 4, 37, 195, 163, 26, 1, 97, 0, 144, 44, 29,
+65,
+7, 100, 2, 179, 6, 120, 0, 6, 1,
+68,
+3, 4, 3, 0, 52,
+71,
+1, 228, 5,
+79,
+1, 124, 144,
+65,
+4, 37, 1, 95, 7, 63,
+67,
+2, 42, 0, 48,
+95,
+127,
+127,
+2, 96, 224, 100,
+135, 255,
+15, 79, 134, 5, 89, 203, 18, 0, 71, 0, 44, 3, 92, 0, 87, 3, 135,
+65,
+11, 2, 4, 0, 56, 0, 146, 3, 155, 6, 159, 6, 4,
+70,
+8, 202, 0, 128, 0, 63, 0, 128, 44, 204,
+67,
+1, 1, 192,
+65,
+1, 1, 192,
+65,
+1, 1, 192,
+65,
+1, 1, 192,
+65,
+1, 1, 192,
+65,
+1, 1, 192,
+76,
+31, 208, 34, 32, 39, 65, 62, 178, 154, 78, 214, 177, 142, 124, 99, 139, 118, 112, 98, 133, 105, 83, 72, 93, 148, 178, 70, 198, 238, 140, 98, 118, 156,
+65,
+0, 53,
+65,
+1, 12, 202,
+104,
+127,
+2, 255, 3, 204,
+66,
+129, 5,
+10, 7, 0, 76, 4, 204, 152, 255, 73, 33, 136, 142,
+66,
+5, 124, 35, 214, 208, 0, 16,
+66,
+4, 16, 81, 2, 4, 15,
+65,
+1, 76, 12,
+73,
+10, 52, 0, 136, 71, 3, 11, 4, 100, 11, 4, 143,
+114,
+127,
+127,
+25, 34, 6, 196, 160, 239, 211, 6, 8, 250, 129, 170, 224, 2, 2, 8, 128, 28, 128, 14, 8, 122, 130, 32, 243, 63, 2,
+73,
+13, 96, 3, 0, 207, 38, 32, 220, 17, 224, 47, 32, 240, 64, 26,
+66,
+2, 125, 31, 44,
+69,
+0, 144,
+65,
+0, 3,
+65,
+20, 248, 31, 248, 31, 248, 30, 208, 32, 248, 10, 142, 30, 48, 0, 56, 8, 36, 10, 11, 234, 26,
+65,
+17, 26, 0, 196, 63, 4, 4, 155, 128, 9, 233, 239, 127, 64, 210, 13, 216, 223, 63,
+67,
+3, 8, 0, 180, 5,
+122,
+127,
+1, 130, 48,
+65,
+17, 48, 17, 66, 48, 1, 148, 17, 127, 0, 116, 0, 6, 0, 146, 1, 1, 150, 5,
+74,
+13, 43, 3, 31, 255, 255, 207, 255, 255, 31, 0, 164, 30, 0, 128,
+67,
+0, 8,
+65,
+26, 16, 180, 204, 179, 0, 2, 0, 4, 3, 0, 4, 0, 105, 0, 255, 255, 7, 255, 255, 7, 0, 68, 0, 224, 40, 62, 192,
+66,
+7, 104, 1, 192, 180, 204, 90, 204, 76,
+83,
+127,
+127,
+3, 216, 0, 87, 241,
+65,
+130, 63,
+130, 127,
+68,
+2, 144, 179, 198,
+65,
+3, 32, 206, 133, 130,
+67,
+8, 128, 4, 208, 32, 15, 0, 64, 0, 5,
+66,
+0, 15,
+65,
+13, 4, 0, 4, 0, 47, 0, 40, 3, 21, 0, 4, 4, 15, 10,
+66,
+30, 192, 3, 11, 39, 6, 126, 6, 0, 192, 5, 192, 4, 192, 52, 192, 103, 192, 103, 192, 0, 192, 5, 192, 192, 33, 192, 5, 192, 1, 200, 6,
+69,
+0, 15,
+75,
+127,
+127,
+};
+const uint16_t programArray240pCrcs[6] PROGMEM = { 0xF7CC, 0xD28F, 0x7FE6, 0xB40C, 0x0239, 0xF7CC };
+
+// 480i: 52 bytes, differences from 240p
+const uint8_t programArray480i[] PROGMEM = {
+1, // base
+198,
+2, 25, 4, 5,
+195,
+4, 225, 0, 48, 30, 12,
+65,
+0, 24,
+196,
+0, 15,
+248,
+127,
+127,
+255,
+255,
+255,
+127,
+255,
+255,
+127,
+255,
+3, 227, 6, 29, 232,
+204,
+0, 41,
+226,
+255,
+127,
+255,
+255,
+0, 1,
+212,
+127,
+127,
+255,
+255,
+127,
+127,
+};
+const uint16_t programArray480iCrcs[6] PROGMEM = { 0xF7CC, 0xD28F, 0x7FE6, 0x1FCA, 0xBF4A, 0xF7CC };
+
+const uint8_t* const presetStreamBases[] PROGMEM = { programArray240p };
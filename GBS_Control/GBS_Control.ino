@@ -1,68 +1,165 @@
 #include <avr/pgmspace.h>
 #include "I2CBitBanger.h"
-#include "StartArray.h"
-#include "ProgramArray240p.h"
-#include "ProgramArray480i.h"
+#include "StartArrayBursts.h"
+#include "PresetStream.h"
+#include "CompressedPresets.h"
+#include "PresetDeltas.h"
 #include "NECIRReceiver.h"
 #include "RemoteControlButtonValues.h"
+#include "SettingsStore.h"
+#include "ScalerRegisterFields.h"
+#include "I2CSniffer.h"
+#include "RegisterConsole.h"
 #include <EEPROM.h>
+#include <util/crc16.h>
 
 // I2C stuff
 #define GBS_I2C_ADDRESS 0x17 // 0x2E
 I2CBitBanger i2cObj(GBS_I2C_ADDRESS);
 
+// Set I2C_SNIFFER_MODE to 1 to build a bus sniffer instead of the controller: the scaler is left to the
+// GBS board's own microcontroller and everything on the bus is streamed out of the TX pin (see I2CSniffer.h)
+#define I2C_SNIFFER_MODE 0
+#if I2C_SNIFFER_MODE
+I2CSniffer i2cSniffer;
+#endif
+
 // remote control stuff
 #define GBS_REMOTE_DSPARK_GPIO_PIN 11
 NECIRReceiver gbsRemoteControl(GBS_REMOTE_DSPARK_GPIO_PIN);
 
 // persitent storage related items
-#define VALID_BANK 0x7e
+SettingsStore settingsStore;
+// (the geometry handlers use the field layout in ScalerRegisterFields.h)
 #define SCALING_SEGMENT 0x03
-#define HRST_LOW  0x01
-#define HRST_HIGH 0x02
-#define HBST_LOW  0x04
-#define HBST_HIGH 0x05
-#define HBSP_LOW  0x05
-#define HBSP_HIGH 0x06
-#define HSCALE_LOW  0x16
-#define HSCALE_HIGH 0x17
-#define VRST_LOW  0x02
-#define VRST_HIGH 0x03
-#define VBST_LOW  0x07
-#define VBST_HIGH 0x08
-#define VBSP_LOW  0x08
-#define VBSP_HIGH 0x09
-
-struct SettingsBank {
-  /*
-   Settings banks are stored in onboard EEPROM.
-   Each bank contains 10 bytes of data
-   One bank consists of the following:
-     byte     value
-     0        validity (byte value VALID_BANK (i.e. 0x7e) if bank contains valid data.  any other value indicates the bank should be ignored)
-     1        horizontal shift low
-     2        horizontal shift med
-     3        horizontal shift high
-     4        horizontal scale low
-     5        horizontal scale high
-     6        vertical shift low
-     7        veritcal shift med
-     8        vertical shift high
-     9        reserved (value currently undefined)
- 
-  uint8_t valid;
-  uint8_t hShiftLow;
-  uint8_t hShiftMed;
-  uint8_t hShiftHigh;
-  uint8_t hScaleLow;
-  uint8_t hScaleHigh;
-  uint8_t vShiftLow;
-  uint8_t vShiftMed;
-  uint8_t vShiftHigh;
-  uint8_t reserved;
-  */
-  uint8_t data[10];
-};
+
+// Functions used before they are defined.  The Arduino IDE generates these,
+// other C++ builds of the sketch (e.g. hostSimulator) need them spelled out.
+bool writeOneByte(uint8_t slaveRegister, uint8_t value);
+bool writeBytes(uint8_t slaveRegister, uint8_t* values, int numValues);
+bool finishProgramArrayAsync(bool wait);
+int readFromRegister(uint8_t reg, int bytesToRead, uint8_t* output);
+int readFromScaler(uint8_t reg, int bytesToRead, uint8_t* output);
+
+// Register shadow
+//
+// A RAM copy of the scaler registers the remote control handlers work with, so they can be
+// computed without reading them back over the (slow) bit banged bus.
+// Only SCALING_SEGMENT registers 0x00 - 0x1F are shadowed (the ATtiny167 only has 512 bytes of RAM).
+// The shadow is filled by any write covering the whole window (i.e. writeProgramArray) and is
+// updated by every write helper below.  If a write to a shadowed register fails, the shadow is
+// marked invalid and reads go to the scaler again until the next full write.
+//
+// Set SHADOW_VERIFY to 1 to read the scaler as well and count reads where the shadow disagreed with it.
+#define SHADOW_VERIFY 0
+#define SHADOW_SEGMENT SCALING_SEGMENT
+#define SHADOW_SIZE 0x20
+#define SEGMENT_UNKNOWN 0xFF
+#define ALL_SEGMENTS 0x3F         // a bit per segment (1<<segment)
+
+uint8_t shadowRegisters[SHADOW_SIZE];
+bool shadowValid = false;
+#if SHADOW_VERIFY
+uint16_t shadowMismatches = 0;
+#endif
+
+// The segment last selected through register 0xF0 (SEGMENT_UNKNOWN if a segment select failed or none was sent yet)
+uint8_t selectedSegment = SEGMENT_UNKNOWN;
+
+
+void trackRegisterWrites(uint8_t slaveRegister, const uint8_t* values, uint16_t numValues, bool valuesInProgmem, bool success)
+{
+  // keeps selectedSegment and the register shadow coherent with a write of numValues consecutive registers
+  for(uint16_t i = 0; i < numValues; i++)
+  {
+    uint16_t reg = slaveRegister + i;
+    uint8_t value = valuesInProgmem ? pgm_read_byte(values + i) : values[i];
+    
+    if(reg == 0xF0)
+    {
+      selectedSegment = success ? value : SEGMENT_UNKNOWN;
+    }
+    else if(selectedSegment == SHADOW_SEGMENT && reg < SHADOW_SIZE)
+    {
+      if(success)
+      {
+        shadowRegisters[reg] = value;
+      }
+      else
+      {
+        shadowValid = false;
+      }
+    }
+  }
+  
+  if(success && selectedSegment == SHADOW_SEGMENT && slaveRegister == 0x00 && numValues >= SHADOW_SIZE)
+  {
+    shadowValid = true;
+  }
+}
+
+
+// Segment select elision
+//
+// selectSegment only writes register 0xF0 when the requested segment is not already selected.
+// Set SEGMENT_SELECT_STATS to 1 to count the selects that were sent and skipped
+// (the counts are blinked out on the LED, low byte first, when button 0 is pressed).
+#define SEGMENT_SELECT_STATS 0
+
+#if SEGMENT_SELECT_STATS
+uint16_t segmentSelectsSent = 0;
+uint16_t segmentSelectsSkipped = 0;
+#endif
+
+
+bool selectSegment(uint8_t segment)
+{
+  if(selectedSegment == segment)
+  {
+#if SEGMENT_SELECT_STATS
+    segmentSelectsSkipped++;
+#endif
+    return true;
+  }
+  
+#if SEGMENT_SELECT_STATS
+  segmentSelectsSent++;
+#endif
+  return writeOneByte(0xF0, segment);
+}
+
+
+// Bus errors
+//
+// Every I2CBitBanger operation is bounded in time (a scaler stretching the clock for longer than I2CBB_STRETCH_TIMEOUT_US
+// fails it) and leaves the bus idle, recovered if needed.  Register writes and reads that timed out are retried up to
+// I2C_RETRIES times, then skipped (the shadow is marked invalid) so the remote keeps working.
+// A NACK isn't retried straight away, the scaler isn't taking transfers at the moment.
+#define I2C_RETRIES 1
+
+bool retryAfterBusError(uint8_t attempt)
+{
+  bool retry = attempt < I2C_RETRIES && i2cObj.getLastError() != I2CBB_ERROR_NACK;
+  if(retry)
+  {
+    i2cObj.countRetry();
+  }
+  return retry;
+}
+
+
+// I2C instrumentation
+//
+// With I2CBB_STATS set to 1 in I2CBitBanger.h, I2CBitBanger counts the transactions, bytes, NACKs, timeouts, retries
+// and bus busy time of each of these callers and keeps a histogram of how long the transactions took, e.g. to profile
+// boot and the remote actions on the board.  setup() and loop() say which caller the transactions that follow are for
+// (a program array written in the background counts for the caller that started it).  The counts are read (and
+// cleared) over the register console with gbsConsole's stats command; with I2CBB_STATS at 0 none of this is compiled in.
+#define I2C_CALLER_BOOT     0  // setup()
+#define I2C_CALLER_REMOTE   1  // the remote control handlers, including preset switches and settings banks
+#define I2C_CALLER_FORMAT   2  // input format detection and the preset switches it makes
+#define I2C_CALLER_VERIFY   3  // readback verification and repairs
+#define I2C_CALLER_CONSOLE  4  // register console requests
 
 
 bool writeOneByte(uint8_t slaveRegister, uint8_t value)
@@ -88,16 +185,28 @@ bool writeBytes(uint8_t slaveAddress, uint8_t slaveRegister, uint8_t* values, ui
  
   //i2cObj.setSlaveAddress(slaveAddress);
   
-  i2cObj.addByteForTransmission(slaveRegister);
+  // a preset being programmed in the background has selected segments of its own
+  finishProgramArrayAsync(true);
   
-  i2cObj.addBytesForTransmission(values, numValues);
+  bool success = false;
   
-  if(!i2cObj.transmitData())
-  {    
-    return false;
+  for(uint8_t attempt = 0; !success; attempt++)
+  {
+    i2cObj.addByteForTransmission(slaveRegister);
+    
+    i2cObj.addBytesForTransmission(values, numValues);
+    
+    success = i2cObj.transmitData();
+    
+    if(!success && !retryAfterBusError(attempt))
+    {
+      break;
+    }
   }
+  
+  trackRegisterWrites(slaveRegister, values, numValues, false, success);
  
-  return true;
+  return success;
 }
 
 
@@ -107,49 +216,547 @@ bool writeBytes(uint8_t slaveRegister, uint8_t* values, int numValues)
 }
 
 
-bool writeStartArray()
+bool writeBytesFromProgmem(uint8_t slaveRegister, const uint8_t* values, uint16_t numValues)
 {
-  for(int z = 0; z < ((sizeof(startArray)/2) - 1520); z++)
+  // same as writeBytes, but the values are streamed straight from flash
+  finishProgramArrayAsync(true);
+  
+  bool success = false;
+  
+  for(uint8_t attempt = 0; !success; attempt++)
   {
-    writeOneByte(pgm_read_byte(startArray + (z*2)), pgm_read_byte(startArray + (z*2) + 1));
-    delay(1);
+    i2cObj.addByteForTransmission(slaveRegister);
+    
+    success = i2cObj.transmitDataFromProgmem(values, numValues);
+    
+    if(!success && !retryAfterBusError(attempt))
+    {
+      break;
+    }
   }
+  
+  trackRegisterWrites(slaveRegister, values, numValues, true, success);
+  
+  return success;
+}
+
+
+// Write combining
+//
+// Handlers queue their register writes with queueRegisterWrites instead of writing each one straight away.
+// flushRegisterWrites sends everything that was queued sorted by segment and register, so every segment is
+// selected once and each run of consecutive registers goes out as one auto-increment write.  A register
+// queued more than once is only written with its last value.  loop() flushes after every handler,
+// readFromRegister and the other direct writes flush first so they see (and don't get overtaken by) queued writes.
+// The queue is flushed early if it fills up.  It holds what the largest handler queues for one flush, the geometry
+// registers switchToProgramArray restores (a settings bank or a verification repair goes out in parts, preset deltas
+// are streamed from flash instead).
+//
+// Set WRITE_COMBINING to 0 to send every queued write immediately instead (e.g. when debugging with a bus analyzer).
+#define WRITE_COMBINING 1
+#define WRITE_QUEUE_SIZE 8
+
+// the geometry registers the remote changes: HBST - VBSP (0x04 - 0x09) and HSCALE (0x16 - 0x17) of SCALING_SEGMENT
+typedef ScalerRegisterFields<HBST, HBSP, VBST, VBSP> BlankingRegisters;
+typedef ScalerRegisterFields<HSCALE> ScaleRegisters;
+
+static_assert(WRITE_QUEUE_SIZE >= BlankingRegisters::numRegisters + ScaleRegisters::numRegisters,
+              "the write queue has to hold the geometry registers switchToProgramArray restores");
+
+#if WRITE_COMBINING
+uint8_t queuedSegments[WRITE_QUEUE_SIZE];   // the queue is kept sorted by segment, then register
+uint8_t queuedRegisters[WRITE_QUEUE_SIZE];
+uint8_t queuedValues[WRITE_QUEUE_SIZE];
+uint8_t numQueuedWrites = 0;
+#endif
+
+
+bool flushRegisterWrites()
+{
+#if WRITE_COMBINING
+  bool success = true;
+  uint8_t i = 0;
+  
+  while(i < numQueuedWrites)
+  {
+    // find the run of consecutive registers starting at i (it has to fit in the I2C buffer with the register address)
+    uint8_t runLength = 1;
+    while(i + runLength < numQueuedWrites && runLength < I2CBB_BUF_SIZE - 2 &&
+          queuedSegments[i + runLength] == queuedSegments[i] &&
+          queuedRegisters[i + runLength] == queuedRegisters[i] + runLength)
+    {
+      runLength++;
+    }
+    
+    if(!selectSegment(queuedSegments[i]) || !writeBytes(queuedRegisters[i], queuedValues + i, runLength))
+    {
+      success = false;
+    }
     
+    i += runLength;
+  }
+  
+  numQueuedWrites = 0;
+  return success;
+#else
   return true;
+#endif
+}
+
+
+void discardRegisterWrites()
+{
+#if WRITE_COMBINING
+  numQueuedWrites = 0;
+#endif
+}
+
+
+bool queueRegisterWrites(uint8_t segment, uint8_t firstRegister, const uint8_t* values, uint8_t numValues)
+{
+  // returns false if the queue had to be flushed to make room and that failed
+#if WRITE_COMBINING
+  bool success = true;
+  
+  for(uint8_t n = 0; n < numValues; n++)
+  {
+    uint8_t reg = firstRegister + n;
+    uint16_t key = ((uint16_t)segment << 8) | reg;
+    
+    // find where the write goes in the sorted queue
+    uint8_t i = numQueuedWrites;
+    while(i > 0 && (((uint16_t)queuedSegments[i - 1] << 8) | queuedRegisters[i - 1]) > key)
+    {
+      i--;
+    }
+    
+    if(i > 0 && queuedSegments[i - 1] == segment && queuedRegisters[i - 1] == reg)
+    {
+      // already queued, the new value replaces it
+      queuedValues[i - 1] = values[n];
+      continue;
+    }
+    
+    if(numQueuedWrites == WRITE_QUEUE_SIZE)
+    {
+      success = flushRegisterWrites() && success;
+      i = 0;
+    }
+    
+    memmove(queuedSegments + i + 1, queuedSegments + i, numQueuedWrites - i);
+    memmove(queuedRegisters + i + 1, queuedRegisters + i, numQueuedWrites - i);
+    memmove(queuedValues + i + 1, queuedValues + i, numQueuedWrites - i);
+    queuedSegments[i] = segment;
+    queuedRegisters[i] = reg;
+    queuedValues[i] = values[n];
+    numQueuedWrites++;
+  }
+  
+  return success;
+#else
+  return selectSegment(segment) && writeBytes(firstRegister, (uint8_t*)values, numValues);
+#endif
+}
+
+
+bool writeBurstArray(const uint8_t* burstArray)
+{
+  /*
+   Writes a PROGMEM burst array generated by sourceSettingsFiles/gbsTableCompiler.
+   Each burst is stored as:
+     count, first register, value 0, value 1, ... value (count-1)
+   and the array is terminated by a count of 0.
+   Every burst is streamed from flash as one auto-increment write transaction (segment selects are bursts to 0xF0).
+  */
+  
+  bool success = flushRegisterWrites();
+  uint8_t count = pgm_read_byte(burstArray);
+  
+  while(count != 0)
+  {
+    uint8_t firstRegister = pgm_read_byte(burstArray + 1);
+    
+    if(firstRegister == 0xF0 && count == 1)
+    {
+      if(!selectSegment(pgm_read_byte(burstArray + 2)))
+      {
+        success = false;
+      }
+    }
+    else if(!writeBytesFromProgmem(firstRegister, burstArray + 2, count))
+    {
+      success = false;
+    }
+    
+    burstArray += count + 2;
+    count = pgm_read_byte(burstArray);
+  }
+  
+  return success;
 }
 
 
+uint8_t burstArraySegments(const uint8_t* burstArray)
+{
+  // returns the segments a PROGMEM burst array writes to (1<<segment each, all of them if it writes before selecting one)
+  uint8_t segments = 0;
+  uint8_t segment = SEGMENT_UNKNOWN;
+  uint8_t count = pgm_read_byte(burstArray);
+  
+  while(count != 0)
+  {
+    if(pgm_read_byte(burstArray + 1) == 0xF0 && count == 1)
+    {
+      segment = pgm_read_byte(burstArray + 2);
+    }
+    else
+    {
+      segments |= (segment < PRESET_NUM_SEGMENTS) ? (1 << segment) : ALL_SEGMENTS;
+    }
+    
+    burstArray += count + 2;
+    count = pgm_read_byte(burstArray);
+  }
+  
+  return segments;
+}
+
+
+bool writeStartArray()
+{
+  // startArrayBursts holds the first 307 (register, value) pairs of StartArray.h
+  // grouped into burst writes, so no per-pair delay is needed
+  return writeBurstArray(startArrayBursts);
+}
+
+
+
+// Differential preset switching
+//
+// The scaler only needs the registers that differ between two program arrays rewritten when switching between them.
+// PresetDeltas.h holds generated burst arrays for every pair of presets (see sourceSettingsFiles/gbsTableCompiler.cpp).
+struct PresetDelta {
+  const uint8_t* fromProgramArray;
+  const uint8_t* toProgramArray;
+  const uint8_t* burstArray;
+};
+
+const PresetDelta presetDeltas[] PROGMEM = {
+  { programArray240p, programArray480i, presetDelta240pTo480i },
+  { programArray480i, programArray240p, presetDelta480iTo240p }
+};
+
+#define NUM_PRESET_DELTAS (sizeof(presetDeltas)/sizeof(PresetDelta))
+
+// The program array currently loaded in the scaler (NULL if unknown, e.g. after a failed write)
+const uint8_t* activeProgramArray = NULL;
+
+// Set when the geometry registers (SCALING_SEGMENT 0x04-0x09 and 0x16-0x17) have been changed away from activeProgramArray
+bool geometryModified = false;
+
+// The settings bank loaded on top of activeProgramArray with the remote (0 if none)
+uint8_t activeSettingsBank = 0;
+
+// Counts the times program array values were written (whole or as a delta), so readback verification knows to start over
+uint8_t programArrayWrites = 0;
+
+// One bit per segment (1<<segment) written since readback verification last checked it
+uint8_t unverifiedSegments = 0;
+
+
+// Program arrays are stored compressed (see PresetStream.h).  programStream decompresses the one
+// being written as its values are clocked out, so nothing more than a few bytes is buffered in RAM.
+PresetStream programStream;
+
+uint8_t nextProgramValue()
+{
+  return programStream.next();
+}
+
+
+void readProgramRegisters(const uint8_t* programArray, uint8_t segment, uint8_t firstRegister, uint8_t numRegisters, uint8_t* output)
+{
+  // looks up a run of registers of one segment in programArray
+  PresetStream reader;
+  reader.read(programArray, segment, firstRegister, numRegisters, output);
+}
+
+
+void trackProgramSegment(const uint8_t* programArray, uint8_t segment, bool success)
+{
+  // the streamed values can't be tracked as they are written, so look up the shadowed ones afterwards
+  if(segment == SHADOW_SEGMENT)
+  {
+    uint8_t window[SHADOW_SIZE];
+    readProgramRegisters(programArray, segment, 0x00, SHADOW_SIZE, window);
+    trackRegisterWrites(0x00, window, SHADOW_SIZE, false, success);
+  }
+}
+
 
 bool writeProgramArray(const uint8_t* programArray)
 { 
+  bool success = true;
+  
+  // programStream may still be feeding an asynchronous write
+  finishProgramArrayAsync(true);
+  
+  // every queued write is to a register the program array overwrites
+  discardRegisterWrites();
+  
+  programArrayWrites++;
+  unverifiedSegments = ALL_SEGMENTS;
+  programStream.begin(programArray);
+  
   for(int y = 0; y < 6; y++)
   { 
-    writeOneByte(0xF0, (uint8_t)y );
-    delay(1);
- 
-    for(int z = 0; z < 15; z++)
+    bool written = selectSegment((uint8_t)y);
+    
+    if(written)
     {
-      uint8_t bank[16];
-      for(int w = 0; w < 16; w++)
+      // registers 0x00 - 0xEF of the segment are decompressed straight onto the bus in one auto-increment write
+      i2cObj.addByteForTransmission(0x00);
+      written = i2cObj.transmitDataFromSource(nextProgramValue, PRESET_REGISTERS_PER_SEGMENT);
+    }
+    
+    if(!written)
+    {
+      // the stream may have stopped part way through the segment
+      success = false;
+      programStream.seek(programArray, y + 1, 0x00);
+    }
+    
+    trackProgramSegment(programArray, (uint8_t)y, written);
+  }
+  
+  activeProgramArray = success ? programArray : NULL;
+  geometryModified = false;
+  activeSettingsBank = 0;
+  
+  return success;
+}
+
+
+// Asynchronous program array writes
+//
+// writeProgramArrayAsync sends the same writes as writeProgramArray on I2CBitBanger's interrupt driven engine and
+// returns straight away, so loop() keeps servicing the remote while a preset is programmed.  The segments go out one
+// at a time through the same two transactions (the segment select and the streamed registers): each call of
+// finishProgramArrayAsync submits the next segment once the last one is done, loop() makes one every pass.
+// The register shadow is updated when the write starts, finishProgramArrayAsync checks the outcome.  Every other
+// write or read of the scaler finishes the program array write first, so it never lands between two segments.
+#define PROGRAM_TRANSACTIONS 2
+
+#if I2CBB_ASYNC_ENABLED
+I2CBBTransaction programTransactions[PROGRAM_TRANSACTIONS];
+const uint8_t segmentNumbers[] PROGMEM = { 0, 1, 2, 3, 4, 5 };
+
+uint8_t pendingProgramSegment;  // the segment last submitted
+bool pendingProgramFailed;      // a segment wasn't written
+uint8_t programStatsCaller;     // the I2CBB_STATS caller that started the write
+#endif
+
+// The program array being written asynchronously (NULL if none)
+const uint8_t* pendingProgramArray = NULL;
+
+
+#if I2CBB_ASYNC_ENABLED
+void submitProgramSegment(uint8_t segment)
+{
+  // the segments are sent in order, so they all draw on programStream
+  uint8_t caller = i2cObj.getStatsCaller();
+  i2cObj.setStatsCaller(programStatsCaller);
+  
+  I2CBBTransaction* select = &programTransactions[0];
+  select->firstRegister = 0xF0;
+  select->data = segmentNumbers + segment;
+  select->length = 1;
+  select->dataInProgmem = true;
+  select->source = NULL;
+  i2cObj.submitTransaction(select);
+  
+  I2CBBTransaction* registers = &programTransactions[1];
+  registers->firstRegister = 0x00;
+  registers->data = NULL;
+  registers->length = PRESET_REGISTERS_PER_SEGMENT;
+  registers->dataInProgmem = false;
+  registers->source = nextProgramValue;
+  i2cObj.submitTransaction(registers);
+  
+  i2cObj.setStatsCaller(caller);
+  pendingProgramSegment = segment;
+}
+#endif
+
+
+void writeProgramArrayAsync(const uint8_t* programArray)
+{
+#if I2CBB_ASYNC_ENABLED
+  // the transactions may still be in use by a previous write
+  finishProgramArrayAsync(true);
+  
+  // every queued write is to a register the program array overwrites
+  discardRegisterWrites();
+  
+  programArrayWrites++;
+  unverifiedSegments = ALL_SEGMENTS;
+  programStream.begin(programArray);
+  
+  for(int y = 0; y < 6; y++)
+  {
+    trackRegisterWrites(0xF0, segmentNumbers + y, 1, true, true);
+    trackProgramSegment(programArray, (uint8_t)y, true);
+  }
+  
+  activeProgramArray = NULL;
+  pendingProgramArray = programArray;
+  pendingProgramFailed = false;
+  programStatsCaller = i2cObj.getStatsCaller();
+  geometryModified = false;
+  activeSettingsBank = 0;
+  
+  submitProgramSegment(0);
+#else
+  writeProgramArray(programArray);
+#endif
+}
+
+
+bool finishProgramArrayAsync(bool wait)
+{
+  // Returns true once no asynchronous program array write is outstanding (always the case if wait is true)
+  if(pendingProgramArray == NULL)
+  {
+    return true;
+  }
+  
+#if I2CBB_ASYNC_ENABLED
+  for(;;)
+  {
+    if(!wait && !i2cObj.isIdle())
+    {
+      return false;
+    }
+    
+    i2cObj.waitForIdle();
+    
+    bool written = true;
+    for(uint8_t i = 0; i < PROGRAM_TRANSACTIONS; i++)
+    {
+      if(programTransactions[i].status != I2CBB_TRANSACTION_DONE)
       {
-        bank[w] = pgm_read_byte(programArray + (y*256 + z*16 + w));
+        written = false;
       }
-      
-      writeBytes(z*16, bank, 16);
-      
-      delay(1);
     }
     
+    if(!written)
+    {
+      // the stream may have stopped part way through the segment
+      pendingProgramFailed = true;
+      programStream.seek(pendingProgramArray, pendingProgramSegment + 1, 0x00);
+    }
+    
+    if(pendingProgramSegment == 5)
+    {
+      break;
+    }
+    
+    submitProgramSegment(pendingProgramSegment + 1);
   }
   
+  if(!pendingProgramFailed)
+  {
+    activeProgramArray = pendingProgramArray;
+  }
+  else
+  {
+    // the shadow and segment were updated assuming everything would be written
+    activeProgramArray = NULL;
+    shadowValid = false;
+    selectedSegment = SEGMENT_UNKNOWN;
+  }
+#endif
+  
+  pendingProgramArray = NULL;
   return true;
 }
 
 
+bool queueProgramRegisters(const uint8_t* programArray, uint8_t segment, uint8_t firstRegister, uint8_t numRegisters)
+{
+  // queues a run of registers of one segment with their values from programArray (at most SHADOW_SIZE registers)
+  uint8_t values[SHADOW_SIZE];
+  readProgramRegisters(programArray, segment, firstRegister, numRegisters, values);
+  
+  return queueRegisterWrites(segment, firstRegister, values, numRegisters);
+}
+
+
+bool switchToProgramArray(const uint8_t* programArray)
+{
+  // Switches the scaler to programArray, writing only the registers that differ from the active program array.
+  // Falls back to writing the whole program array (asynchronously) if the active one is unknown or there is no delta for the pair.
+  
+  finishProgramArrayAsync(true);
+  
+  const uint8_t* deltaBurstArray = NULL;
+  
+  for(uint8_t i = 0; i < NUM_PRESET_DELTAS; i++)
+  {
+    if((const uint8_t*)pgm_read_word(&presetDeltas[i].fromProgramArray) == activeProgramArray &&
+       (const uint8_t*)pgm_read_word(&presetDeltas[i].toProgramArray) == programArray)
+    {
+      deltaBurstArray = (const uint8_t*)pgm_read_word(&presetDeltas[i].burstArray);
+    }
+  }
+  
+  if(activeProgramArray == NULL || (activeProgramArray != programArray && deltaBurstArray == NULL))
+  {
+    writeProgramArrayAsync(programArray);
+    return true;
+  }
+  
+  bool success = true;
+  
+  if(deltaBurstArray != NULL || geometryModified)
+  {
+    programArrayWrites++;
+  }
+  
+  if(deltaBurstArray != NULL)
+  {
+    // streamed from flash, a delta is longer than the write queue
+    success = writeBurstArray(deltaBurstArray);
+    unverifiedSegments |= burstArraySegments(deltaBurstArray);
+  }
+  
+  if(geometryModified)
+  {
+    unverifiedSegments |= (1<<SCALING_SEGMENT);
+    
+    // the deltas assume the registers match the active program array, so undo any remote control adjustments
+    // (after the delta, so these values win where they both write a register)
+    success = queueProgramRegisters(programArray, BlankingRegisters::segment, BlankingRegisters::firstRegister, BlankingRegisters::numRegisters) &&
+              queueProgramRegisters(programArray, ScaleRegisters::segment, ScaleRegisters::firstRegister, ScaleRegisters::numRegisters) && success;
+  }
+  
+  success = flushRegisterWrites() && success;
+  
+  activeProgramArray = success ? programArray : NULL;
+  geometryModified = false;
+  activeSettingsBank = 0;
+  
+  return success;
+}
+
+
 int readFromRegister(uint8_t segment, uint8_t reg, int bytesToRead, uint8_t* output) {
   
+  // queued writes have to reach the scaler (and the shadow) first
+  flushRegisterWrites();
+  
   // go to the appropriate segment
-  if(!writeOneByte(0xF0, segment)) {
+  if(!selectSegment(segment)) {
     return 0;
   }
   
@@ -157,13 +764,330 @@ int readFromRegister(uint8_t segment, uint8_t reg, int bytesToRead, uint8_t* out
 }
 
 int readFromRegister(uint8_t reg, int bytesToRead, uint8_t* output) {
+  
+  // shadowed registers are served from RAM
+  if(shadowValid && selectedSegment == SHADOW_SEGMENT && (reg + bytesToRead) <= SHADOW_SIZE) {
+    
+#if SHADOW_VERIFY
+    int bytesRead = readFromScaler(reg, bytesToRead, output);
+    for(int i = 0; i < bytesRead; i++) {
+      if(output[i] != shadowRegisters[reg + i]) {
+        shadowMismatches++;
+        shadowRegisters[reg + i] = output[i]; // trust the hardware
+      }
+    }
+    return bytesRead;
+#else
+    memcpy(output, shadowRegisters + reg, bytesToRead);
+    return bytesToRead;
+#endif
+  }
+  
+  return readFromScaler(reg, bytesToRead, output);
+}
+
+int readFromScaler(uint8_t reg, int bytesToRead, uint8_t* output) {
+  
+  finishProgramArrayAsync(true);
+  
+  // go to the appropriate register and read from it in one transaction (repeated start)
+  for(uint8_t attempt = 0; ; attempt++) {
+    i2cObj.addByteForTransmission(reg);
+    
+    int bytesRead = i2cObj.writeThenRead(bytesToRead, output);
+    
+    if(bytesRead == bytesToRead || !retryAfterBusError(attempt)) {
+      return bytesRead;
+    }
+  }
+}
+
+bool readBack(uint8_t segment, uint8_t reg, uint8_t numRegisters, uint8_t* output)
+{
+  // reads registers from the scaler itself, never from the shadow
+  flushRegisterWrites();
+  return selectSegment(segment) && readFromScaler(reg, numRegisters, output) == numRegisters;
+}
+
+
+// Readback verification
+//
+// Nothing confirms that the scaler latched what was written: a write that failed part way (or a byte it didn't take)
+// leaves a corrupted picture.  So after every program array write and preset switch, loop() reads back the registers
+// 0x00 - 0xEF of each segment the write touched (unverifiedSegments), VERIFY_READ_SIZE registers per auto-increment
+// read and one read per pass so the remote stays responsive, and compares their CRC with the one gbsTableCompiler
+// stored next to the preset (programArray<name>Crcs in CompressedPresets.h).  A segment whose CRC differs is read
+// again a bank of VERIFY_BANK_SIZE registers at a time against the decompressed preset, and only the banks that
+// differ are rewritten (up to VERIFY_RETRIES times).  Registers 0x00 - 0x2F of segment 0 are read only status
+// registers, they are left out.  Once the geometry has been changed with the remote (or a settings bank loaded) the
+// shadowed registers of SHADOW_SEGMENT no longer match the preset, so that segment is compared bank by bank with the
+// shadow over the preset instead of by its CRC.
+//
+// verifyPassUs is how long the last complete verification took, verifyBanksRewritten counts the banks that had to
+// be rewritten, verifyFailures the banks that still differed after that and the segments whose CRC still did
+// (gbsConsole's status command prints them).
+#define PROGRAM_VERIFY           1
+#define VERIFY_READ_SIZE         32   // a multiple of VERIFY_BANK_SIZE
+#define VERIFY_BANK_SIZE         16
+#define VERIFY_RETRIES           2
+#define VERIFY_STATUS_REGISTERS  0x30 // segment 0 registers below this can't be read back
+#define VERIFY_CRC_INITIAL       0xFFFF
+
+#define VERIFY_CRC      0  // reading a segment for its CRC
+#define VERIFY_REPAIR   1  // going through it bank by bank
+#define VERIFY_RECHECK  2  // reading it for its CRC again after that
+
+#if PROGRAM_VERIFY
+#if SHADOW_SIZE % VERIFY_BANK_SIZE
+#error "the shadow has to cover whole verification banks"
+#endif
+
+struct PresetChecksums {
+  const uint8_t* programArray;
+  const uint16_t* segmentCrcs;  // PROGMEM
+};
+
+const PresetChecksums presetChecksums[] PROGMEM = {
+  { programArray240p, programArray240pCrcs },
+  { programArray480i, programArray480iCrcs }
+};
+
+#define NUM_PRESET_CHECKSUMS (sizeof(presetChecksums)/sizeof(PresetChecksums))
+
+const uint8_t* verifyingProgramArray = NULL;  // NULL if no verification is running
+const uint16_t* verifyingCrcs;
+uint8_t verifyingWrites;                      // programArrayWrites when it started
+uint8_t verifiedWrites = 0;                   // ...when the last one finished
+uint8_t verifySegment;
+uint8_t verifyRegister;
+uint8_t verifyStep;                           // VERIFY_CRC, VERIFY_REPAIR or VERIFY_RECHECK
+uint16_t verifyCrc;
+unsigned long verifyStartUs;
+
+unsigned long verifyPassUs = 0;
+uint16_t verifyBanksRewritten = 0;
+uint16_t verifyFailures = 0;
+
+
+bool shadowDiffersFromPreset(uint8_t segment)
+{
+  // true if segment's registers are to be compared with the shadow rather than the preset's CRC
+  return segment == SHADOW_SEGMENT && geometryModified;
+}
+
+
+void startVerifyingSegment(uint8_t segment, uint8_t step)
+{
+  verifySegment = segment;
+  verifyRegister = (segment == 0) ? VERIFY_STATUS_REGISTERS : 0x00;
+  verifyStep = shadowDiffersFromPreset(segment) ? VERIFY_REPAIR : step;
+  verifyCrc = VERIFY_CRC_INITIAL;
+}
+
+
+void startVerifyingNextSegment()
+{
+  // starts on the lowest segment still to be verified (unverifiedSegments isn't 0)
+  uint8_t segment = 0;
+  while((unverifiedSegments & (1<<segment)) == 0)
+  {
+    segment++;
+  }
+  
+  startVerifyingSegment(segment, VERIFY_CRC);
+}
+
+
+void segmentVerified()
+{
+  // moves on from verifySegment
+  unverifiedSegments &= ~(1<<verifySegment);
+  if(unverifiedSegments != 0)
+  {
+    startVerifyingNextSegment();
+    return;
+  }
+  
+  verifyingProgramArray = NULL;
+  verifiedWrites = verifyingWrites;
+  verifyPassUs = micros() - verifyStartUs;
+}
+
+
+void verifyProgramArray()
+{
+  // does one read of the verification of activeProgramArray (if it needs verifying)
+  if(!finishProgramArrayAsync(false))
+  {
+    return;
+  }
+  
+  if(activeProgramArray == NULL)
+  {
+    verifyingProgramArray = NULL;
+    return;
+  }
+  
+  if(verifyingProgramArray != activeProgramArray || verifyingWrites != programArrayWrites)
+  {
+    // (re)start, unless everything written has been verified already
+    verifyingProgramArray = NULL;
+    if(unverifiedSegments == 0)
+    {
+      verifiedWrites = programArrayWrites;
+      return;
+    }
+    
+    for(uint8_t i = 0; i < NUM_PRESET_CHECKSUMS; i++)
+    {
+      if((const uint8_t*)pgm_read_word(&presetChecksums[i].programArray) == activeProgramArray)
+      {
+        verifyingProgramArray = activeProgramArray;
+        verifyingCrcs = (const uint16_t*)pgm_read_word(&presetChecksums[i].segmentCrcs);
+      }
+    }
+    
+    if(verifyingProgramArray == NULL)
+    {
+      // there is nothing to compare with
+      unverifiedSegments = 0;
+      verifiedWrites = programArrayWrites;
+      return;
+    }
+    
+    verifyingWrites = programArrayWrites;
+    verifyStartUs = micros();
+    startVerifyingNextSegment();
+  }
+  
+  uint8_t values[VERIFY_READ_SIZE];
+  
+  if(verifyStep == VERIFY_REPAIR)
+  {
+    // one bank
+    uint8_t expected[VERIFY_BANK_SIZE];
+    if(shadowDiffersFromPreset(verifySegment) && verifyRegister < SHADOW_SIZE)
+    {
+      if(!shadowValid)
+      {
+        // nothing to compare with, skip the bank
+        verifyRegister += VERIFY_BANK_SIZE;
+        return;
+      }
+      memcpy(expected, shadowRegisters + verifyRegister, VERIFY_BANK_SIZE);
+    }
+    else
+    {
+      readProgramRegisters(verifyingProgramArray, verifySegment, verifyRegister, VERIFY_BANK_SIZE, expected);
+    }
+    
+    for(uint8_t attempt = 0; ; attempt++)
+    {
+      if(!readBack(verifySegment, verifyRegister, VERIFY_BANK_SIZE, values))
+      {
+        return; // try again on the next pass
+      }
+      
+      if(memcmp(values, expected, VERIFY_BANK_SIZE) == 0)
+      {
+        break;
+      }
+      
+      if(attempt == VERIFY_RETRIES)
+      {
+        verifyFailures++;
+        break;
+      }
+      
+      queueRegisterWrites(verifySegment, verifyRegister, expected, VERIFY_BANK_SIZE);
+      flushRegisterWrites();
+      verifyBanksRewritten++;
+    }
     
-  // go to the appropriate register
-  i2cObj.addByteForTransmission(reg);
-  i2cObj.transmitData();
+    verifyRegister += VERIFY_BANK_SIZE;
+    if(verifyRegister == PRESET_REGISTERS_PER_SEGMENT)
+    {
+      if(shadowDiffersFromPreset(verifySegment))
+      {
+        // its CRC can't be checked, each bank was
+        segmentVerified();
+      }
+      else
+      {
+        startVerifyingSegment(verifySegment, VERIFY_RECHECK);
+      }
+    }
+    return;
+  }
   
-  return i2cObj.recvData(bytesToRead, output);
+  uint8_t numRegisters = PRESET_REGISTERS_PER_SEGMENT - verifyRegister;
+  if(numRegisters > VERIFY_READ_SIZE)
+  {
+    numRegisters = VERIFY_READ_SIZE;
+  }
+  
+  if(!readBack(verifySegment, verifyRegister, numRegisters, values))
+  {
+    return; // try again on the next pass
+  }
+  
+  for(uint8_t i = 0; i < numRegisters; i++)
+  {
+    verifyCrc = _crc_ccitt_update(verifyCrc, values[i]);
+  }
+  verifyRegister += numRegisters;
+  
+  if(verifyRegister < PRESET_REGISTERS_PER_SEGMENT)
+  {
+    return;
+  }
+  
+  if(verifyCrc != pgm_read_word(verifyingCrcs + verifySegment))
+  {
+    if(verifyStep == VERIFY_CRC || shadowDiffersFromPreset(verifySegment))
+    {
+      // (or the geometry was changed while the CRC was being read)
+      startVerifyingSegment(verifySegment, VERIFY_REPAIR);
+      return;
+    }
+    
+    // a bank couldn't be repaired, or the banks match the preset and the CRC doesn't (CompressedPresets.h out of date?)
+    verifyFailures++;
+  }
+  
+  segmentVerified();
+}
+#endif
+
+
+// Register console
+//
+// Set REGISTER_CONSOLE to 1 in RegisterConsole.h to let a host read and write any scaler register over the LIN/UART pins (a USB serial
+// adapter on pins 6 and 7, see RegisterConsole.h), e.g. to try out register values or upload a .set file with
+// hostConsole/gbsConsole.cpp without reflashing.  loop() answers a request each pass.
+// Console writes go straight out (after anything queued) and keep the shadow and the selected segment up to date.
+// The scaler no longer holds a known program array after one, so nothing is verified and the next preset switch
+// writes a whole program array.
+#if REGISTER_CONSOLE
+RegisterConsole registerConsole;
+
+
+bool consoleReadRegisters(uint8_t segment, uint8_t firstRegister, uint8_t numRegisters, uint8_t* output)
+{
+  finishProgramArrayAsync(true);
+  return readBack(segment, firstRegister, numRegisters, output);
+}
+
+
+bool consoleWriteRegisters(uint8_t segment, uint8_t firstRegister, uint8_t* values, uint8_t numValues)
+{
+  finishProgramArrayAsync(true);
+  activeProgramArray = NULL;
+
+  flushRegisterWrites();
+  return selectSegment(segment) && writeBytes(firstRegister, values, numValues);
 }
+#endif
 
 
 // Macros for a "Resolution" switch which allows for toggling between
@@ -202,201 +1126,198 @@ bool lastKnownResolutionSwitchState = true;
 #define LED_BIT 1
 
 void returnToDefaultSettings() {
-  writeProgramArray(programArray480i); //
+  writeProgramArrayAsync(programArray480i); //
   LED_PORT &= ~(1<<LED_BIT); // turn off LED
 }
 
-void shiftHorizontal(uint16_t amountToAdd, bool subtracting) {
-  
-  uint8_t hrstLow = 0x00;
-  uint8_t hrstHigh = 0x00;
-  uint16_t hrstValue = 0x0000;
-  uint8_t hbstLow = 0x00;
-  uint8_t hbstHigh = 0x00;
-  uint16_t hbstValue = 0x0000;
-  uint8_t hbspLow = 0x00;
-  uint8_t hbspHigh = 0x00;
-  uint16_t hbspValue = 0x0000;
-  
-  // get HRST
-  if(readFromRegister(SCALING_SEGMENT, HRST_LOW, 1, &hrstLow) != 1) {
-    return;
-  }
-  
-  if(readFromRegister(HRST_HIGH, 1, &hrstHigh) != 1) {
-    return;
-  }
-  
-  hrstValue = ( ( ((uint16_t)hrstHigh) & 0x0007) << 8) | (uint16_t)hrstLow;
-  
-  // get HBST
-  if(readFromRegister(HBST_LOW, 1, &hbstLow) != 1) {
-    return;
+uint16_t adjustWithin(uint16_t value, uint16_t amount, bool subtracting, uint16_t maxValue) {
+  // value plus or minus amount, kept within 0 - maxValue (held buttons add up to large steps)
+  int32_t result = subtracting ? (int32_t)value - amount : (int32_t)value + amount;
+  if(result < 0) {
+    return 0;
   }
-  
-  if(readFromRegister(HBST_HIGH, 1, &hbstHigh) != 1) {
-    return;
+  if(result > maxValue) {
+    return maxValue;
   }
+  return (uint16_t)result;
+}
+
+void shiftHorizontal(uint16_t amountToAdd, bool subtracting) {
   
-  hbstValue = ( ( ((uint16_t)hbstHigh) & 0x000f) << 8) | (uint16_t)hbstLow;
-  
-  // get HBSP
-  hbspLow = hbstHigh;
-  
-  if(readFromRegister(HBSP_HIGH, 1, &hbspHigh) != 1) {
+  // HRST through HBSP are in consecutive registers, read them all in one go
+  ScalerRegisterFields<HRST, HBST, HBSP> fields;
+  if(!fields.read()) {
     return;
   }
   
-  hbspValue = ( ( ((uint16_t)hbspHigh) & 0x00ff) << 4) | ( (((uint16_t)hbspLow) & 0x00f0) >> 4);
-  
-  // Perform the addition/subtraction
-  if(subtracting) {
-    hbstValue -= amountToAdd;
-    hbspValue -= amountToAdd;
-  } else {
-    hbstValue += amountToAdd;
-    hbspValue += amountToAdd;
-  }
-  
-  // handle the case where hbst or hbsp have been decremented below 0
-  if(hbstValue & 0x8000) {
-    hbstValue = hrstValue-1;
-  }
+  // both stay within the line (0 - HRST-1)
+  uint16_t hrstValue = fields.get<HRST>();
+  uint16_t lastPixel = (hrstValue > 0) ? hrstValue - 1 : 0;
+  uint16_t hbstValue = adjustWithin(fields.get<HBST>(), amountToAdd, subtracting, lastPixel);
+  uint16_t hbspValue = adjustWithin(fields.get<HBSP>(), amountToAdd, subtracting, lastPixel);
   
-  if(hbspValue & 0x8000) {
-    hbspValue = hrstValue-1;
-  }
+  geometryModified = true;
   
-  writeOneByte(HBST_LOW, (uint8_t)(hbstValue & 0x00ff));
-  writeOneByte(HBST_HIGH, ((uint8_t)(hbspValue & 0x000f) << 4) | ((uint8_t)((hbstValue & 0x0f00) >> 8)) );
-  writeOneByte(HBSP_HIGH, (uint8_t)((hbspValue & 0x0ff0) >> 4) );  
+  // HBST and HBSP share a register, both go out in the same write
+  fields.set<HBST>(hbstValue);
+  fields.set<HBSP>(hbspValue);
+  fields.write();
 }
 
 
-void shiftHorizontalLeft() {
-  shiftHorizontal(4, true);
+void shiftHorizontalLeft(uint16_t amount) {
+  shiftHorizontal(amount, true);
 }
 
-void shiftHorizontalRight() {
-  shiftHorizontal(4, false);
+void shiftHorizontalRight(uint16_t amount) {
+  shiftHorizontal(amount, false);
 }
 
 void scaleHorizontal(uint16_t amountToAdd, bool subtracting) {
-  uint8_t high = 0x00;
-  uint8_t newHigh = 0x00;
-  uint8_t low = 0x00;
-  uint8_t newLow = 0x00;
-  uint16_t newValue = 0x0000;
-  
-  if(readFromRegister(SCALING_SEGMENT, HSCALE_LOW, 1, &low) != 1) {
-    return;
-  }
   
-  if(readFromRegister(HSCALE_HIGH, 1, &high) != 1) {
+  ScalerRegisterFields<HSCALE> fields;
+  if(!fields.read()) {
     return;
   }
   
-  newValue = ( ( ((uint16_t)high) & 0x0003) * 256) + (uint16_t)low;
-  
-  if(subtracting) {
-    newValue -= amountToAdd;
-  } else {
-    newValue += amountToAdd;
-  }
+  // HSCALE is 10 bits wide, don't let it wrap around
+  uint16_t newValue = adjustWithin(fields.get<HSCALE>(), amountToAdd, subtracting, 1023);
   
-  newHigh = (high & 0xfc) | (uint8_t)( (newValue / 256) & 0x0003);
-  newLow = (uint8_t)(newValue & 0x00ff);
+  geometryModified = true;
   
-  writeOneByte(HSCALE_LOW, newLow);
-  writeOneByte(HSCALE_HIGH, newHigh);
+  fields.set<HSCALE>(newValue);
+  fields.write();
 }
 
-void scaleHorizontalSmaller() {
-  scaleHorizontal(4, false);
+void scaleHorizontalSmaller(uint16_t amount) {
+  scaleHorizontal(amount, false);
 }
 
-void scaleHorizontalLarger() {
-  scaleHorizontal(4, true);
+void scaleHorizontalLarger(uint16_t amount) {
+  scaleHorizontal(amount, true);
 }
 
 
 void shiftVertical(uint16_t amountToAdd, bool subtracting) {
   
-  uint8_t vrstLow = 0x00;
-  uint8_t vrstHigh = 0x00;
-  uint16_t vrstValue = 0x0000;
-  uint8_t vbstLow = 0x00;
-  uint8_t vbstHigh = 0x00;
-  uint16_t vbstValue = 0x0000;
-  uint8_t vbspLow = 0x00;
-  uint8_t vbspHigh = 0x00;
-  uint16_t vbspValue = 0x0000;
-  
-  // get VRST
-  if(readFromRegister(SCALING_SEGMENT, VRST_LOW, 1, &vrstLow) != 1) {
+  // VRST through VBSP are in consecutive registers, read them all in one go
+  ScalerRegisterFields<VRST, VBST, VBSP> fields;
+  if(!fields.read()) {
     return;
   }
   
-  if(readFromRegister(VRST_HIGH, 1, &vrstHigh) != 1) {
-    return;
-  }
-  
-  vrstValue = ( (((uint16_t)vrstHigh) & 0x007f) << 4) | ( (((uint16_t)vrstLow) & 0x00f0) >> 4);
-  
-  // get VBST
-  if(readFromRegister(VBST_LOW, 1, &vbstLow) != 1) {
-    return;
-  }
+  // both stay within the frame (0 - VRST-1)
+  uint16_t vrstValue = fields.get<VRST>();
+  uint16_t lastLine = (vrstValue > 0) ? vrstValue - 1 : 0;
+  uint16_t vbstValue = adjustWithin(fields.get<VBST>(), amountToAdd, subtracting, lastLine);
+  uint16_t vbspValue = adjustWithin(fields.get<VBSP>(), amountToAdd, subtracting, lastLine);
   
-  if(readFromRegister(VBST_HIGH, 1, &vbstHigh) != 1) {
-    return;
-  }
+  geometryModified = true;
   
-  vbstValue = ( ( ((uint16_t)vbstHigh) & 0x0007) << 8) | (uint16_t)vbstLow;
-  
-  // get VBSP
-  vbspLow = vbstHigh;
-  
-  if(readFromRegister(VBSP_HIGH, 1, &vbspHigh) != 1) {
-    return;
+  // VBST and VBSP share a register, both go out in the same write
+  fields.set<VBST>(vbstValue);
+  fields.set<VBSP>(vbspValue);
+  fields.write();
+}
+
+
+void shiftVerticalUp(uint16_t amount) {
+  shiftVertical(amount, true);
+}
+
+void shiftVerticalDown(uint16_t amount) {
+  shiftVertical(amount, false);
+}
+
+
+
+// Hold-to-repeat for the geometry buttons
+//
+// While a button is held the remote sends NEC repeat frames (about every 108ms).
+// Repeats of a geometry button apply the adjustment again, with a step that grows the longer the button is held.
+// Repeats that have queued up while the previous adjustment was being written are applied as one update.
+#define GEOMETRY_STEP            4
+#define GEOMETRY_STEP_HELD       16    // after GEOMETRY_HELD_MS
+#define GEOMETRY_STEP_LONG_HELD  64    // after GEOMETRY_LONG_HELD_MS
+#define GEOMETRY_HELD_MS         1000
+#define GEOMETRY_LONG_HELD_MS    2500
+
+int heldButton = NEC_NO_INPUT;        // the geometry button repeat frames refer to (NEC_NO_INPUT if none)
+unsigned long heldSinceMillis = 0;    // when heldButton was pressed
+
+
+bool isGeometryButton(int button) {
+  switch(button) {
+    case BUTTON_PREV:
+    case BUTTON_NEXT:
+    case BUTTON_VOL_MINUS:
+    case BUTTON_VOL_PLUS:
+    case BUTTON_PLAY_PAUSE:
+    case BUTTON_EQ:
+      return true;
+      
+    default:
+      return false;
   }
-  
-  vbspValue = ( ( ((uint16_t)vbspHigh) & 0x007f) << 4) | ( (((uint16_t)vbspLow) & 0x00f0) >> 4);
-  
-  // Perform the addition/subtraction
-  if(subtracting) {
-    vbstValue -= amountToAdd;
-    vbspValue -= amountToAdd;
-  } else {
-    vbstValue += amountToAdd;
-    vbspValue += amountToAdd;
+}
+
+
+bool adjustGeometry(int button, uint16_t amount) {
+  // applies the geometry adjustment of a remote button, returns false if it isn't a geometry button
+  switch(button) {
+    
+    case BUTTON_PREV: // Horizontal shift left 
+      shiftHorizontalLeft(amount);
+      break;
+      
+    case BUTTON_NEXT: // Horizontal shift right 
+      shiftHorizontalRight(amount);
+      break;
+      
+    case BUTTON_VOL_MINUS: // Horizontal scale smaller 
+      scaleHorizontalSmaller(amount);
+      break;
+      
+    case BUTTON_VOL_PLUS: // Horizontal scall larger 
+      scaleHorizontalLarger(amount);
+      break;
+      
+    case BUTTON_PLAY_PAUSE: // Vertical shift up 
+      shiftVerticalUp(amount);
+      break;
+      
+    case BUTTON_EQ: // Vertical shift down
+      shiftVerticalDown(amount); 
+      break;
+      
+    default:
+      return false;
   }
   
-  // handle the case where hbst or hbsp have been decremented below 0
-  if(vbstValue & 0x8000) {
-    vbstValue = vrstValue-1;
+  return true;
+}
+
+
+void repeatHeldButton() {
+  // batch any further repeats that are already waiting
+  uint16_t repeats = 1;
+  while(gbsRemoteControl.peekIRButtonValue() == NEC_REPEAT) {
+    gbsRemoteControl.getIRButtonValue();
+    repeats++;
   }
   
-  if(vbspValue & 0x8000) {
-    vbspValue = vrstValue-1;
+  unsigned long heldMillis = millis() - heldSinceMillis;
+  uint16_t step = GEOMETRY_STEP;
+  if(heldMillis >= GEOMETRY_LONG_HELD_MS) {
+    step = GEOMETRY_STEP_LONG_HELD;
+  } else if(heldMillis >= GEOMETRY_HELD_MS) {
+    step = GEOMETRY_STEP_HELD;
   }
   
-  writeOneByte(VBST_LOW, (uint8_t)(vbstValue & 0x00ff));
-  writeOneByte(VBST_HIGH, ((uint8_t)(vbspValue & 0x000f) << 4) | ((uint8_t)((vbstValue & 0x0700) >> 8)) );
-  writeOneByte(VBSP_HIGH, (uint8_t)((vbspValue & 0x07f0) >> 4) );
-}
-
-
-void shiftVerticalUp() {
-  shiftVertical(4, true);
-}
-
-void shiftVerticalDown() {
-  shiftVertical(4, false);
+  adjustGeometry(heldButton, repeats * step);
 }
 
 
-
 void debugWithLED(int numBytes, uint8_t* buf) {
 
       for(int i = 0; i < numBytes; i++) {
@@ -438,69 +1359,136 @@ void debugWithLED(int numBytes, uint8_t* buf) {
 }
 
 
-void saveCurrentSettingsToBank(uint16_t bankNumber) {
-  // save the current scalar settings
-  
-  /*
-     One bank consists of the following:
-     byte     value
-     0        validity (byte value VALID_BANK (i.e. 0x7e) if bank contains valid data.  any other value indicates the bank should be ignored)
-     1        horizontal shift low
-     2        horizontal shift med
-     3        horizontal shift high
-     4        horizontal scale low
-     5        horizontal scale high
-     6        vertical shift low
-     7        veritcal shift med
-     8        vertical shift high
-     9        reserved (value currently undefined)
-  */
+// Settings snapshots
+//
+// A settings bank is a snapshot of the whole scaler register file, stored as the program array it was
+// based on plus the registers that differ from it.  Outside the shadow window the live registers always
+// match activeProgramArray (only whole program arrays and deltas are written there), so the differences
+// are found by comparing the shadow with the base program array; nothing is read back over I2C.
+//
+// Snapshot layout (up to SETTINGS_DATA_SIZE bytes):
+//   byte     value
+//   0        base program array (index into snapshotBases)
+//   1...     runs of SHADOW_SEGMENT registers that differ from the base: first register, count, values...
+//
+// More bases (e.g. a custom preset) can be added to the end of snapshotBases, existing indices must not change.
+const uint8_t* const snapshotBases[] PROGMEM = { programArray240p, programArray480i };
+#define NUM_SNAPSHOT_BASES (sizeof(snapshotBases)/sizeof(snapshotBases[0]))
+#define SNAPSHOT_BASE_480I 1
+#define SNAPSHOT_MAX_GAP 2  // unchanged registers that are stored rather than starting a new run
+
+
+const uint8_t* snapshotBase(uint8_t baseIndex)
+{
+  // snapshotBases[baseIndex], the table is in flash
+  return (const uint8_t*)pgm_read_word(&snapshotBases[baseIndex]);
+}
+
+
+uint8_t encodeSnapshot(uint8_t baseIndex, const uint8_t* window, uint8_t* snapshot)
+{
+  // builds a snapshot of window (SHADOW_SIZE registers) against snapshotBases[baseIndex]
+  // returns the snapshot length, or 0 if it does not fit in SETTINGS_DATA_SIZE bytes
+  uint8_t base[SHADOW_SIZE];
+  uint8_t length = 0;
+  uint8_t runStart = 0; // index of the current run's header in snapshot (0 = no run)
+  int lastDifference = -1;
   
-  SettingsBank newSave;
-  newSave.data[0] = VALID_BANK;
-  newSave.data[9] = 0x00;
+  readProgramRegisters(snapshotBase(baseIndex), SHADOW_SEGMENT, 0x00, SHADOW_SIZE, base);
+  snapshot[length++] = baseIndex;
   
-  if(readFromRegister(SCALING_SEGMENT, HBST_LOW, 1, &newSave.data[1]) != 1) {
-    return;
+  for(uint8_t reg = 0; reg < SHADOW_SIZE; reg++)
+  {
+    if(window[reg] == base[reg])
+    {
+      continue;
+    }
+    
+    if(runStart != 0 && reg - lastDifference - 1 <= SNAPSHOT_MAX_GAP)
+    {
+      // extend the current run through the (unchanged) gap
+      for(uint8_t gap = lastDifference + 1; gap <= reg; gap++)
+      {
+        if(length >= SETTINGS_DATA_SIZE)
+        {
+          return 0;
+        }
+        snapshot[length++] = window[gap];
+        snapshot[runStart + 1]++;
+      }
+    }
+    else
+    {
+      if(length + 3 > SETTINGS_DATA_SIZE)
+      {
+        return 0;
+      }
+      runStart = length;
+      snapshot[length++] = reg;
+      snapshot[length++] = 1;
+      snapshot[length++] = window[reg];
+    }
+    
+    lastDifference = reg;
   }
   
-  if(readFromRegister(HBST_HIGH, 1, &newSave.data[2]) != 1) {
-    return;
+  return length;
+}
+
+
+bool decodeSnapshot(const uint8_t* snapshot, uint8_t length, uint8_t* window)
+{
+  // fills window (SHADOW_SIZE registers) with the base program array's values and applies the stored differences
+  if(length < 1 || snapshot[0] >= NUM_SNAPSHOT_BASES)
+  {
+    return false;
   }
   
-  if(readFromRegister(HBSP_HIGH, 1, &newSave.data[3]) != 1) {
-    return;
-  }
+  readProgramRegisters(snapshotBase(snapshot[0]), SHADOW_SEGMENT, 0x00, SHADOW_SIZE, window);
   
-  if(readFromRegister(HSCALE_LOW, 1, &newSave.data[4]) != 1) {
-    return;
+  uint8_t i = 1;
+  while(i < length)
+  {
+    uint8_t firstRegister = snapshot[i];
+    uint8_t count = (i + 1 < length) ? snapshot[i + 1] : 0;
+    
+    if(count == 0 || firstRegister + count > SHADOW_SIZE || i + 2 + count > length)
+    {
+      return false;
+    }
+    
+    memcpy(window + firstRegister, snapshot + i + 2, count);
+    i += 2 + count;
   }
   
-  if(readFromRegister(HSCALE_HIGH, 1, &newSave.data[5]) != 1) {
-    return;
-  }
+  return true;
+}
+
+
+bool saveCurrentSettingsToBank(uint16_t bankNumber) {
+  // save a snapshot of the current scaler settings
+  // returns false if the live registers are not known or differ from their program array in too many places
   
-  newSave.data[5] &= 0x03; // we don't need to save surrounding data
+  finishProgramArrayAsync(true);
+  flushRegisterWrites();
   
-  if(readFromRegister(VBST_LOW, 1, &newSave.data[6]) != 1) {
-    return;
+  if(activeProgramArray == NULL || !shadowValid) {
+    return false;
   }
   
-  if(readFromRegister(VBST_HIGH, 1, &newSave.data[7]) != 1) {
-    return;
+  uint8_t baseIndex = 0;
+  while(baseIndex < NUM_SNAPSHOT_BASES && snapshotBase(baseIndex) != activeProgramArray) {
+    baseIndex++;
   }
   
-  if(readFromRegister(VBSP_HIGH, 1, &newSave.data[8]) != 1) {
-    return;
+  if(baseIndex == NUM_SNAPSHOT_BASES) {
+    return false;
   }
   
-  uint16_t address = 0 + (sizeof(SettingsBank) * bankNumber);
-  
-  for(int i=0; i < sizeof(SettingsBank); i++) {
-    EEPROM.write(address + i, newSave.data[i]);
-  }
+  uint8_t snapshot[SETTINGS_DATA_SIZE];
+  uint8_t length = encodeSnapshot(baseIndex, shadowRegisters, snapshot);
   
-  return;
+  return length != 0 && settingsStore.save(bankNumber, snapshot, length);
 }
 
 void saveCurrentSettings() {
@@ -597,57 +1585,425 @@ void saveCurrentSettings() {
 
 
 void loadStoredSettings(uint8_t bankNumber) {  
-  uint16_t address = 0 + (sizeof(SettingsBank) * bankNumber);
+  uint8_t snapshot[SETTINGS_DATA_SIZE];
+  uint8_t length;
+  uint8_t window[SHADOW_SIZE];
+  
+  // fetch the stored settings (fails if the bank was never saved)
+  if(!settingsStore.load(bankNumber, snapshot, &length) || !decodeSnapshot(snapshot, length, window)) {
+    return;
+  }
+  
+  const uint8_t* base = snapshotBase(snapshot[0]);
   
-  SettingsBank setting;
+  finishProgramArrayAsync(true);
+  
+  if(activeProgramArray != base) {
+    // bring everything outside the window to the base program array.
+    // the window is compared with the snapshot below, so don't restore the geometry on the way
+    geometryModified = false;
+    switchToProgramArray(base);
+    finishProgramArrayAsync(true);
+    
+    if(activeProgramArray != base) {
+      return;
+    }
+  }
   
-  // fetch the stored settings
-  for(int i=0; i < sizeof(SettingsBank); i++) {
-    setting.data[i] = EEPROM.read(address + i); 
+  // write only the runs of window registers that differ from the live ones
+  // (all of them if the shadow isn't trusted), bridging small gaps like the snapshot does
+  uint8_t reg = 0;
+  while(reg < SHADOW_SIZE) {
+    if(shadowValid && shadowRegisters[reg] == window[reg]) {
+      reg++;
+      continue;
+    }
+    
+    uint8_t runEnd = reg + 1; // one past the last register that differs
+    uint8_t next = runEnd;
+    while(next < SHADOW_SIZE && next - runEnd <= SNAPSHOT_MAX_GAP && next - reg < I2CBB_BUF_SIZE - 2) {
+      if(!shadowValid || shadowRegisters[next] != window[next]) {
+        runEnd = next + 1;
+      }
+      next++;
+    }
+    
+    queueRegisterWrites(SHADOW_SEGMENT, reg, window + reg, runEnd - reg);
+    
+    reg = runEnd;
   }
   
-  // check if the settings bank is valid
-  if(setting.data[0] != VALID_BANK) {
+  if(!flushRegisterWrites()) {
     return;
   }
   
-  // write the settings to the scalar chip over i2c
-  /*
-     One bank consists of the following:
-     byte     value
-     0        validity (byte value VALID_BANK (i.e. 0x7e) if bank contains valid data.  any other value indicates the bank should be ignored)
-     1        horizontal shift low
-     2        horizontal shift med
-     3        horizontal shift high
-     4        horizontal scale low
-     5        horizontal scale high
-     6        vertical shift low
-     7        veritcal shift med
-     8        vertical shift high
-     9        reserved (value currently undefined)
-  */
+  unverifiedSegments |= (1<<SHADOW_SEGMENT);
+  geometryModified = (length > 1);
+  activeSettingsBank = bankNumber;
+}
+
+
+// Input format detection
+//
+// The scaler's sync processor measures the input by itself, so the source format is read from its status
+// registers (segment 0, see ScalerRegisterFields.h) instead of from the old resolution switch.  loop() reads the
+// lines per field every FORMAT_POLL_MS (less than a field, so every field is seen), skipping polls while a program
+// array is being written in the background.  A 480i source alternates between 262 and 263 lines, a 240p source
+// sends the same count every field.  So two alternations in a row mean 480i, and a count that hasn't changed for
+// FORMAT_INTERLACE_MS means 240p, 2-3 fields after the sync processor has locked to a new source.
+// Reads are slow on this bus (a 2 byte poll takes about 1ms), so the sync active flags are only read to confirm
+// a new format before switching; anything other than a 60Hz source (no sync, 50Hz, 480p) leaves the preset alone.
+//
+// The matching preset is only switched to when the detected format changes, so one picked with CH+/CH- stays
+// until the source does.  Set AUTO_FORMAT_DETECTION to 0 to switch by remote only.
+//
+// For tuning, formatPollUs is how long the last poll took, formatDetectedMs when (millis()) the current format was
+// detected and formatSwitchUs how long switching to its preset took.
+#define AUTO_FORMAT_DETECTION   1
+#define FORMAT_POLL_MS          12
+#define FORMAT_INTERLACE_MS     36   // well over two polls, the longest a 480i source goes without a change being seen
+#define FORMAT_FIELD_LINES_MIN  258  // 60Hz sources
+#define FORMAT_FIELD_LINES_MAX  266
+
+#define FORMAT_NONE  0
+#define FORMAT_240P  1
+#define FORMAT_480I  2
+
+#if AUTO_FORMAT_DETECTION
+uint8_t detectedFormat = FORMAT_NONE;
+unsigned long lastFormatPollMs = 0;
+uint16_t lastFieldLines = 0;          // 0 = no sync
+unsigned long fieldLinesSteadyMs = 0; // when the lines per field last changed
+uint8_t fieldLineAlternations = 0;    // changes by one line since then (up to 2)
+
+unsigned long formatPollUs = 0;
+unsigned long formatDetectedMs = 0;
+unsigned long formatSwitchUs = 0;
+
+
+void detectInputFormat()
+{
+  unsigned long now = millis();
+  
+  if(now - lastFormatPollMs < FORMAT_POLL_MS || !finishProgramArrayAsync(false))
+  {
+    return;
+  }
+  lastFormatPollMs = now;
+  
+  unsigned long pollStartUs = micros();
+  ScalerRegisterFields<STATUS_SP_VTOTAL> status;
+  if(!status.read())
+  {
+    return;
+  }
+  formatPollUs = micros() - pollStartUs;
+  
+  uint16_t fieldLines = status.get<STATUS_SP_VTOTAL>();
+  
+  if(fieldLines != lastFieldLines)
+  {
+    if(fieldLines == lastFieldLines + 1 || fieldLines + 1 == lastFieldLines)
+    {
+      // the next field of an interlaced source (or a one off glitch)
+      if(fieldLineAlternations < 2)
+      {
+        fieldLineAlternations++;
+      }
+    }
+    else
+    {
+      // a new source
+      fieldLineAlternations = 0;
+    }
+    lastFieldLines = fieldLines;
+    fieldLinesSteadyMs = now;
+  }
+  else if(now - fieldLinesSteadyMs >= FORMAT_INTERLACE_MS)
+  {
+    fieldLineAlternations = 0;
+  }
+  
+  if(fieldLines < FORMAT_FIELD_LINES_MIN || fieldLines > FORMAT_FIELD_LINES_MAX)
+  {
+    return;
+  }
+  
+  uint8_t format;
+  if(fieldLineAlternations >= 2)
+  {
+    format = FORMAT_480I;
+  }
+  else if(fieldLineAlternations == 0 && now - fieldLinesSteadyMs >= FORMAT_INTERLACE_MS)
+  {
+    format = FORMAT_240P;
+  }
+  else
+  {
+    return; // not sure yet
+  }
+  
+  if(format == detectedFormat)
+  {
+    return;
+  }
   
-  uint8_t existingHscaleHigh = 0x00;
-  if(readFromRegister(SCALING_SEGMENT, HSCALE_HIGH, 1, &existingHscaleHigh) != 1) {
+  // the count may be left over from a source that has gone
+  ScalerRegisterFields<STATUS_SP_HSACT, STATUS_SP_VSACT> sync;
+  if(!sync.read() || !sync.get<STATUS_SP_HSACT>() || !sync.get<STATUS_SP_VSACT>())
+  {
+    // look again once there is a different count
+    lastFieldLines = 0;
     return;
   }
   
-  writeOneByte(HBST_LOW, setting.data[1]);
-  writeOneByte(HBST_HIGH, setting.data[2]);
-  writeOneByte(HBSP_HIGH, setting.data[3]);
-  writeOneByte(HSCALE_LOW, setting.data[4]);
+  detectedFormat = format;
+  formatDetectedMs = now;
   
-  uint8_t newHscaleHigh = (existingHscaleHigh & 0xfc) | ((setting.data[5]) & 0x03);
-  writeOneByte(HSCALE_HIGH, newHscaleHigh);
+  unsigned long switchStartUs = micros();
+  if(format == FORMAT_240P)
+  {
+    switchToProgramArray(programArray240p);
+    LED_PORT |= (1<<LED_BIT); // turn on LED
+  }
+  else
+  {
+    switchToProgramArray(programArray480i);
+    LED_PORT &= ~(1<<LED_BIT); // turn off LED
+  }
+  formatSwitchUs = micros() - switchStartUs;
+}
+#endif
+
+
+// Scaler readiness
+//
+// The scaler doesn't answer on the bus until it is out of reset.  Instead of relying on fixed delays, setup()
+// polls its address (see I2CBitBanger::waitForAck) before the start array and before the program array, so
+// boot carries on as soon as the scaler ACKs and doesn't send everything into the void on a slow board.
+// How long each wait took (and how many timed out) is kept for diagnostics (gbsConsole's status command).
+#define SCALER_READY_TIMEOUT_MS  500
+#define BOOT_WAIT_START_ARRAY    0
+#define BOOT_WAIT_PROGRAM_ARRAY  1
+
+unsigned long bootWaitUs[2];     // indexed by BOOT_WAIT_...
+uint8_t bootWaitTimeouts = 0;
+
+bool waitForScaler(uint8_t bootWait)
+{
+  // returns false if the scaler didn't ACK within SCALER_READY_TIMEOUT_MS (the writes are attempted anyway)
+  if(i2cObj.waitForAck(SCALER_READY_TIMEOUT_MS, &bootWaitUs[bootWait]))
+  {
+    return true;
+  }
   
-  writeOneByte(VBST_LOW, setting.data[6]);
-  writeOneByte(VBST_HIGH, setting.data[7]);
-  writeOneByte(VBSP_HIGH, setting.data[8]);
+  bootWaitTimeouts++;
+  return false;
+}
+
+
+// Fast boot
+//
+// With FAST_BOOT set to 1, setup() follows the start array (sent as it is) with the preset's burst array from
+// BootImages.h instead of the whole program array.  gbsTableCompiler's boot command leaves out of it every register
+// that already holds its value after power up and the start array, which takes a fraction of the bus time.  This is
+// only as good as the power up values it was generated from, so BootImages.h isn't part of the sketch: capture them
+// from the board first (build with BOOT_CAPTURE_POWER_UP set to 1, power the board up and save the registers with
+// gbsConsole's save command), then generate it (see README.txt).  The preset is read back by PROGRAM_VERIFY as after
+// any write, which rewrites any register that didn't power up as captured (e.g. when only the Digispark was reset),
+// so FAST_BOOT needs it.
+//
+// It boots into the preset and settings bank that were in use last time: loop() records them in the settings store
+// (bank BOOT_STATE_BANK, the remote only uses 1-9) once they have been in use for BOOT_STATE_SAVE_MS, so a source that
+// keeps changing format doesn't wear the EEPROM out.  Nothing recorded boots into 480i.  The bank is only loaded once
+// the preset has been verified, well before a display has locked to the picture.
+//
+// Boot state layout: byte 0 is the preset (index into snapshotBases), byte 1 the settings bank (0 if none).
+#define FAST_BOOT             0
+#define BOOT_CAPTURE_POWER_UP 0   // 1: setup() doesn't write to the scaler at all
+#define BOOT_STATE_BANK    0
+#define BOOT_STATE_SIZE    2
+#define BOOT_STATE_SAVE_MS 5000
+#define BOOT_STATE_NONE    0xFF
+
+#if FAST_BOOT && !PROGRAM_VERIFY
+#error "FAST_BOOT relies on PROGRAM_VERIFY to rewrite the registers that didn't power up as captured"
+#endif
+
+#if BOOT_CAPTURE_POWER_UP && !REGISTER_CONSOLE
+#error "BOOT_CAPTURE_POWER_UP needs REGISTER_CONSOLE to save the registers"
+#endif
+
+#if FAST_BOOT
+#include "BootImages.h"  // generated from the captured power up values, see README.txt
+
+// the boot image of each preset in snapshotBases, in the same order
+const uint8_t* const bootImages[] PROGMEM = { bootImage240p, bootImage480i };
+
+uint8_t recordedBootState[BOOT_STATE_SIZE] = { BOOT_STATE_NONE, 0 };  // what the settings store holds
+uint8_t bootStateCandidate[BOOT_STATE_SIZE] = { BOOT_STATE_NONE, 0 }; // what was in use when loop() last looked
+unsigned long bootStateSinceMs = 0;                                    // ...since when
+
+uint8_t bootSettingsBank = 0;       // the recorded bank, until it has been loaded (0 if none)
+uint8_t bootProgramArrayWrites;     // programArrayWrites after the boot image
+
+
+void bootIntoRecordedState()
+{
+  // writes the boot image of the recorded preset (480i if there is none) after the start array
+  // and leaves its settings bank to finishFastBoot
+  uint8_t length;
+  if(!settingsStore.load(BOOT_STATE_BANK, recordedBootState, &length) || length != BOOT_STATE_SIZE ||
+     recordedBootState[0] >= NUM_SNAPSHOT_BASES)
+  {
+    recordedBootState[0] = BOOT_STATE_NONE;
+    recordedBootState[1] = 0;
+  }
+
+  uint8_t preset = (recordedBootState[0] == BOOT_STATE_NONE) ? SNAPSHOT_BASE_480I : recordedBootState[0];
+  const uint8_t* programArray = snapshotBase(preset);
+
+  programArrayWrites++;
+  unverifiedSegments = ALL_SEGMENTS;
+  if(!writeBurstArray((const uint8_t*)pgm_read_word(&bootImages[preset])))
+  {
+    // write all of it
+    writeProgramArrayAsync(programArray);
+  }
+  else
+  {
+    // the registers left out of the image already hold the preset's values
+    readProgramRegisters(programArray, SHADOW_SEGMENT, 0x00, SHADOW_SIZE, shadowRegisters);
+    shadowValid = true;
+    activeProgramArray = programArray;
+    geometryModified = false;
+    activeSettingsBank = 0;
+  }
+
+  if(programArray == programArray240p)
+  {
+    LED_PORT |= (1<<LED_BIT); // turn on LED
+  }
+  else
+  {
+    LED_PORT &= ~(1<<LED_BIT); // turn off LED
+  }
+
+  bootSettingsBank = recordedBootState[1];
+  bootProgramArrayWrites = programArrayWrites;
+}
+
+
+void finishFastBoot()
+{
+  // loads the recorded settings bank once the boot image has been verified
+  if(bootSettingsBank == 0 || !finishProgramArrayAsync(false))
+  {
+    return;
+  }
+
+  if(programArrayWrites != bootProgramArrayWrites || activeProgramArray == NULL || geometryModified)
+  {
+    // something else has been picked with the remote (or the input) since
+    bootSettingsBank = 0;
+    return;
+  }
+
+#if PROGRAM_VERIFY
+  if(verifiedWrites != programArrayWrites)
+  {
+    return;
+  }
+#endif
+
+  loadStoredSettings(bootSettingsBank);
+  bootSettingsBank = 0;
+}
+
+
+void recordBootState()
+{
+  // saves the preset and settings bank in use once they have been for BOOT_STATE_SAVE_MS
+  if(bootSettingsBank != 0 || activeProgramArray == NULL)
+  {
+    return;
+  }
+
+#if PROGRAM_VERIFY
+  if(verifyingProgramArray != NULL)
+  {
+    return; // it may not have been programmed right
+  }
+#endif
+
+  uint8_t state[BOOT_STATE_SIZE] = { 0, activeSettingsBank };
+  while(state[0] < NUM_SNAPSHOT_BASES && snapshotBase(state[0]) != activeProgramArray)
+  {
+    state[0]++;
+  }
+
+  if(state[0] == NUM_SNAPSHOT_BASES)
+  {
+    return;
+  }
+
+  unsigned long now = millis();
+
+  if(memcmp(state, bootStateCandidate, BOOT_STATE_SIZE) != 0)
+  {
+    memcpy(bootStateCandidate, state, BOOT_STATE_SIZE);
+    bootStateSinceMs = now;
+    return;
+  }
+
+  if(memcmp(state, recordedBootState, BOOT_STATE_SIZE) != 0 && now - bootStateSinceMs >= BOOT_STATE_SAVE_MS &&
+     settingsStore.save(BOOT_STATE_BANK, state, BOOT_STATE_SIZE))
+  {
+    memcpy(recordedBootState, state, BOOT_STATE_SIZE);
+  }
+}
+#endif
+
+
+#if REGISTER_CONSOLE
+void consoleStatus(ConsoleStatus* status)
+{
+  // the diagnostics of the sections above, for gbsConsole's status command
+  status->bootWaitUs[BOOT_WAIT_START_ARRAY] = bootWaitUs[BOOT_WAIT_START_ARRAY];
+  status->bootWaitUs[BOOT_WAIT_PROGRAM_ARRAY] = bootWaitUs[BOOT_WAIT_PROGRAM_ARRAY];
+  status->bootWaitTimeouts = bootWaitTimeouts;
+  
+#if SHADOW_VERIFY
+  status->built |= CONSOLE_BUILT_SHADOW_VERIFY;
+  status->shadowMismatches = shadowMismatches;
+#endif
+  
+#if AUTO_FORMAT_DETECTION
+  status->built |= CONSOLE_BUILT_FORMAT_DETECT;
+  status->formatPollUs = formatPollUs;
+  status->formatDetectedMs = formatDetectedMs;
+  status->formatSwitchUs = formatSwitchUs;
+#endif
+  
+#if PROGRAM_VERIFY
+  status->built |= CONSOLE_BUILT_PROGRAM_VERIFY;
+  status->verifyPassUs = verifyPassUs;
+  status->verifyBanksRewritten = verifyBanksRewritten;
+  status->verifyFailures = verifyFailures;
+#endif
 }
+#endif
 
 
 void setup() {
   
+  i2cObj.setStatsCaller(I2C_CALLER_BOOT);
+  
+#if I2C_SNIFFER_MODE
+  // only listen, this never returns
+  i2cSniffer.run();
+#endif
+  
   // We setup and read the value of the Resolution switch
   // to determine if we are initially going 
   // to write 240p or 480i settings to the scaler chip
@@ -664,11 +2020,21 @@ void setup() {
   LED_DDR |= (1<<LED_BIT);  
   
   // Remote control stuff
-  pinMode(GBS_REMOTE_DSPARK_GPIO_PIN, INPUT);
+  gbsRemoteControl.begin();
+  
+#if REGISTER_CONSOLE
+  registerConsole.begin();
+#endif
+  
+  // Find the saved settings banks
+  settingsStore.begin();
   
    
-  // Write the start array
+#if !BOOT_CAPTURE_POWER_UP
+  // Write the start array once the scaler answers
+  waitForScaler(BOOT_WAIT_START_ARRAY);
   writeStartArray();
+#endif
   
   /* OLD SWITCH CODE
   if(currentResolutionSwitchState == true) {
@@ -685,22 +2051,46 @@ void setup() {
   lastKnownResolutionSwitchState = currentResolutionSwitchState;
   */
   
+#if BOOT_CAPTURE_POWER_UP
+  // the scaler is left as it powered up for gbsConsole's save command
+#elif FAST_BOOT
+  // Program the scaler with the preset it had last time
+  waitForScaler(BOOT_WAIT_PROGRAM_ARRAY);
+  bootIntoRecordedState();
+#else
+  waitForScaler(BOOT_WAIT_PROGRAM_ARRAY);
   returnToDefaultSettings();
+#endif
 }
 
 
 void loop() {
-    
+  
+  i2cObj.setStatsCaller(I2C_CALLER_REMOTE);
+  
+  // record the outcome of a preset that was being programmed in the background
+  finishProgramArrayAsync(false);
+  
   int remoteControlButton = gbsRemoteControl.getIRButtonValue();
+  
+  if(remoteControlButton >= 0) {
+    // a new button press, remember it for any repeat frames that follow if they are to be repeated
+    heldButton = isGeometryButton(remoteControlButton) ? remoteControlButton : NEC_NO_INPUT;
+    heldSinceMillis = millis();
+  } else if(remoteControlButton == NEC_INVALID) {
+    // the repeat frames that follow may belong to a button that wasn't decoded
+    heldButton = NEC_NO_INPUT;
+  }
+  
   switch(remoteControlButton) {
       
     case BUTTON_CH_MINUS: // Change to 480i default mode
-      writeProgramArray(programArray480i); //
+      switchToProgramArray(programArray480i);
       LED_PORT &= ~(1<<LED_BIT); // turn off LED
       break;
       
     case BUTTON_CH_PLUS:  // Change to 240p default mode
-      writeProgramArray(programArray240p);
+      switchToProgramArray(programArray240p);
       LED_PORT |= (1<<LED_BIT); // turn on LED
       break;
           
@@ -709,27 +2099,12 @@ void loop() {
       break;
     
     case BUTTON_PREV: // Horizontal shift left 
-      shiftHorizontalLeft();
-      break;
-      
     case BUTTON_NEXT: // Horizontal shift right 
-      shiftHorizontalRight();
-      break;
-      
     case BUTTON_VOL_MINUS: // Horizontal scale smaller 
-      scaleHorizontalSmaller();
-      break;
-      
     case BUTTON_VOL_PLUS: // Horizontal scall larger 
-      scaleHorizontalLarger();
-      break;
-      
     case BUTTON_PLAY_PAUSE: // Vertical shift up 
-      shiftVerticalUp();
-      break;
-      
     case BUTTON_EQ: // Vertical shift down
-      shiftVerticalDown(); 
+      adjustGeometry(remoteControlButton, GEOMETRY_STEP);
       break;
       
     case BUTTON_1: // Load the saved setting
@@ -771,13 +2146,49 @@ void loop() {
     case BUTTON_200_PLUS: // Used to save current settings
       saveCurrentSettings(); 
       break;
+      
+#if SEGMENT_SELECT_STATS
+    case BUTTON_0: // Blink out the segment select counters (sent, then skipped)
+      debugWithLED(2, (uint8_t*)&segmentSelectsSent);
+      debugWithLED(2, (uint8_t*)&segmentSelectsSkipped);
+      break;
+#endif
     
-    case -1: 
-      break;  // Unrecognized input.  Don't change any settings.  This also ignores held down button sequences
+    case NEC_REPEAT: 
+      repeatHeldButton();  // Held down button.  Only geometry adjustments are repeated.
+      break;
     
     default:
       break;
   }
+  
+  // send the register writes the handler queued
+  flushRegisterWrites();
+  
+#if AUTO_FORMAT_DETECTION
+  // switch presets when the source changes format
+  i2cObj.setStatsCaller(I2C_CALLER_FORMAT);
+  detectInputFormat();
+#endif
+  
+#if PROGRAM_VERIFY
+  // check the scaler took the last preset written, a little at a time
+  i2cObj.setStatsCaller(I2C_CALLER_VERIFY);
+  verifyProgramArray();
+#endif
+  
+#if REGISTER_CONSOLE
+  // take register reads and writes from a host
+  i2cObj.setStatsCaller(I2C_CALLER_CONSOLE);
+  registerConsole.service();
+#endif
+  
+#if FAST_BOOT
+  // load the settings bank booted into once the preset checks out, and keep track of what to boot into next time
+  i2cObj.setStatsCaller(I2C_CALLER_BOOT);
+  finishFastBoot();
+  recordBootState();
+#endif
     
   
   /* OLD SWITCH CODE
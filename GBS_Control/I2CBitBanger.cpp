@@ -1,10 +1,102 @@
 
 #include "I2CBitBanger.h"
 #include <util/delay.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
 
 // Initialize statics
 uint8_t I2CBitBanger::I2CBB_Buffer[I2CBB_BUF_SIZE];             // Buffer to hold I2C data
 uint8_t I2CBitBanger::I2CBB_BufferIndex = 0;                    // The current index value into the buffer
+uint8_t I2CBitBanger::lastError = I2CBB_OK;
+volatile bool I2CBitBanger::busNeedsRecovery = false;
+
+// polls of a stretched SCL before giving up
+#define STRETCH_POLLS (I2CBB_STRETCH_TIMEOUT_US / I2CBB_STRETCH_POLL_US)
+
+#if I2CBB_STATS
+I2CBBStats I2CBitBanger::stats;
+uint8_t I2CBitBanger::statsCaller = 0;
+unsigned long I2CBitBanger::transactionStartUs = 0;
+
+// Instrumentation hooks (nothing unless I2CBB_STATS is 1)
+#define I2CBB_COUNT(caller, field)                      (stats.callers[caller].field++)
+#define I2CBB_TRANSACTION_STARTED(caller)               transactionStarted(caller)
+#define I2CBB_TRANSACTION_ENDED(caller, nack, timeout)  transactionEnded(caller, nack, timeout)
+#else
+#define I2CBB_COUNT(caller, field)
+#define I2CBB_TRANSACTION_STARTED(caller)
+#define I2CBB_TRANSACTION_ENDED(caller, nack, timeout)
+#endif
+
+// The end of a transaction of the synchronous functions, lastError says how it went
+#define I2CBB_SYNC_TRANSACTION_ENDED()                                  \
+  I2CBB_TRANSACTION_ENDED(statsCaller, lastError == I2CBB_ERROR_NACK,   \
+                          lastError == I2CBB_ERROR_TIMEOUT || lastError == I2CBB_ERROR_BUS_STUCK)
+
+#if I2CBB_ASYNC_ENABLED
+// States of the interrupt driven write state machine
+#define ASYNC_IDLE          0
+#define ASYNC_NEXT          1  // start the next queued transaction (if any)
+#define ASYNC_START_SCL_LOW 2
+#define ASYNC_BIT           3  // put the next bit on SDA
+#define ASYNC_BIT_SCL_HIGH  4
+#define ASYNC_BIT_SCL_LOW   5
+#define ASYNC_ACK           6  // release SDA for the slave's ACK
+#define ASYNC_ACK_SCL_HIGH  7
+#define ASYNC_ACK_SAMPLE    8
+#define ASYNC_STOP          9
+#define ASYNC_STOP_SCL_HIGH 10
+#define ASYNC_STOP_SDA_HIGH 11
+#define ASYNC_STRETCH       12 // wait for the slave to release SCL, then go to asyncStretchReturnState
+
+// polls of a stretched SCL before giving up (the timer can't poll more often than I2CBB_ASYNC_MIN_US)
+#define ASYNC_STRETCH_POLLS (I2CBB_STRETCH_TIMEOUT_US / I2CBB_ASYNC_MIN_US)
+
+I2CBBTransaction* volatile I2CBitBanger::asyncQueue[I2CBB_QUEUE_SIZE];
+volatile uint8_t I2CBitBanger::asyncQueueHead = 0;
+volatile uint8_t I2CBitBanger::asyncQueueTail = 0;
+volatile uint8_t I2CBitBanger::asyncState = ASYNC_IDLE;
+uint16_t I2CBitBanger::asyncByteIndex = 0;
+uint8_t I2CBitBanger::asyncByte = 0;
+uint8_t I2CBitBanger::asyncBitMask = 0;
+uint8_t I2CBitBanger::asyncResult = I2CBB_TRANSACTION_DONE;
+uint8_t I2CBitBanger::asyncStretchReturnState = ASYNC_IDLE;
+uint16_t I2CBitBanger::asyncStretchPolls = 0;
+
+// Timer1 ticks for a bus phase (rounded up)
+constexpr uint16_t i2cbbAsyncTicks(double phaseUs) {
+  return (uint16_t)(phaseUs * (F_CPU / I2CBB_ASYNC_PRESCALER) / 1000000.0) + 1;
+}
+
+// Moves the state machine on to nextState after phaseUs microseconds.
+// Short phases are busy-waited inside the interrupt, longer ones are left to Timer1 so the sketch can run meanwhile.
+#define I2CBB_ASYNC_WAIT_US(phaseUs, nextState)                         \
+  asyncState = (nextState);                                            \
+  if((phaseUs) < I2CBB_ASYNC_MIN_US) {                                 \
+    _delay_us(i2cbbDelayUs(phaseUs));                                  \
+  } else {                                                             \
+    OCR1A = i2cbbAsyncTicks(phaseUs) - 1;                              \
+    TCNT1 = 0;                                                         \
+    TIFR1 = (1<<OCF1A);                                                \
+    return;                                                            \
+  }
+
+// The same after the given timing profile phase
+#define I2CBB_ASYNC_WAIT(phase, nextState) I2CBB_ASYNC_WAIT_US(I2CBBActiveTiming::phase, nextState)
+
+// Goes to ASYNC_STRETCH (and from there on to returnState) if the slave is holding SCL low
+#define I2CBB_ASYNC_CHECK_STRETCH(returnState)                          \
+  if((PIN_I2CBB & (1<<SCL_BIT)) == 0x00) {                             \
+    asyncStretchReturnState = (returnState);                           \
+    asyncStretchPolls = ASYNC_STRETCH_POLLS;                           \
+    asyncState = ASYNC_STRETCH;                                        \
+    break;                                                             \
+  }
+
+ISR(TIMER1_COMPA_vect) {
+  I2CBitBanger::handleTimerInterrupt();
+}
+#endif
 
 
 I2CBitBanger::I2CBitBanger(uint8_t sevenBitAddressArg) {
@@ -35,7 +127,7 @@ void I2CBitBanger::setSlaveAddress(uint8_t sevenBitAddressArg) {
 
 void I2CBitBanger::addByteForTransmission(uint8_t data) { 
   // stores data to send later
-  if (I2CBB_BufferIndex >= I2CBB_BUF_SIZE) {
+  if (I2CBB_BufferIndex >= (I2CBB_BUF_SIZE - 1)) {
     return; // return to avoid exceeding buffer size
   }
 
@@ -53,6 +145,9 @@ void I2CBitBanger::addBytesForTransmission(uint8_t* buffer, uint8_t bufferSize)
 
 
 bool I2CBitBanger::transmitData() {
+  // let any asynchronous writes finish first
+  waitForIdle();
+  
   // make sure the RW bit is a write (set the RW bit to 0)
   I2CBB_Buffer[0] &= ~(I2CBB_RW_BIT_POSITION);
    
@@ -63,102 +158,490 @@ bool I2CBitBanger::transmitData() {
 }
 
 
+bool I2CBitBanger::transmitDataFromProgmem(const uint8_t* progmemBuffer, uint16_t bufferSize) {
+  // let any asynchronous writes finish first
+  waitForIdle();
+  
+  // make sure the RW bit is a write (set the RW bit to 0)
+  I2CBB_Buffer[0] &= ~(I2CBB_RW_BIT_POSITION);
+  
+  uint8_t ramBytes = I2CBB_BufferIndex + 1;
+  I2CBB_BufferIndex = 0;
+  
+  if(!startTransaction()) {
+    return false;
+  }
+  
+  // first the slave address and anything queued with addByteForTransmission
+  for(uint8_t i = 0; i < ramBytes; i++) {
+    if(!sendI2cByte(I2CBB_Buffer[i])) {
+      abortTransaction();
+      return false;
+    }
+  }
+  
+  // then clock the flash contents straight onto the bus
+  for(uint16_t i = 0; i < bufferSize; i++) {
+    if(!sendI2cByte(pgm_read_byte(progmemBuffer + i))) {
+      abortTransaction();
+      return false;
+    }
+  }
+  
+  sendI2cStopSignal();
+  I2CBB_SYNC_TRANSACTION_ENDED();
+  
+  return true;
+}
+
+
+bool I2CBitBanger::transmitDataFromSource(I2CBBByteSource source, uint16_t bufferSize) {
+  // let any asynchronous writes finish first
+  waitForIdle();
+  
+  // make sure the RW bit is a write (set the RW bit to 0)
+  I2CBB_Buffer[0] &= ~(I2CBB_RW_BIT_POSITION);
+  
+  uint8_t ramBytes = I2CBB_BufferIndex + 1;
+  I2CBB_BufferIndex = 0;
+  
+  if(!startTransaction()) {
+    return false;
+  }
+  
+  // first the slave address and anything queued with addByteForTransmission
+  for(uint8_t i = 0; i < ramBytes; i++) {
+    if(!sendI2cByte(I2CBB_Buffer[i])) {
+      abortTransaction();
+      return false;
+    }
+  }
+  
+  // then each byte as the source produces it
+  for(uint16_t i = 0; i < bufferSize; i++) {
+    if(!sendI2cByte(source())) {
+      abortTransaction();
+      return false;
+    }
+  }
+  
+  sendI2cStopSignal();
+  I2CBB_SYNC_TRANSACTION_ENDED();
+  
+  return true;
+}
+
+
 int I2CBitBanger::recvData(int numBytesToRead, uint8_t* outputBuffer) {
+  // let any asynchronous writes finish first
+  waitForIdle();
+  
   // make sure the RW bit is a read (set the RW bit to 1)
   I2CBB_Buffer[0] |= I2CBB_RW_BIT_POSITION;
   
-  sendI2cStartSignal();
+  if(!startTransaction()) {
+    return 0;
+  }
   
   // Start the read by sending the slave address + RW bit set to read
   if(!sendI2cByte(I2CBB_Buffer[0])) { 
+    abortTransaction();
     return 0;
   }
   
-  
-  int i = 0;
-  while(i < numBytesToRead) {
-	
-    if(i == (numBytesToRead-1)) {
-      // on the last byte, we send a NAK
-      receiveI2cByte(false, outputBuffer + i);
+  return receiveBytes(numBytesToRead, outputBuffer);
+}
 
-    } else {
-      // read a byte, sending an ACK
-      receiveI2cByte(true, outputBuffer + i);
+
+int I2CBitBanger::writeThenRead(int numBytesToRead, uint8_t* outputBuffer) {
+  // let any asynchronous writes finish first
+  waitForIdle();
+  
+  // make sure the RW bit is a write (set the RW bit to 0)
+  I2CBB_Buffer[0] &= ~(I2CBB_RW_BIT_POSITION);
+  
+  uint8_t ramBytes = I2CBB_BufferIndex + 1;
+  I2CBB_BufferIndex = 0;
+  
+  if(!startTransaction()) {
+    return 0;
+  }
+  
+  // the write part (slave address and e.g. the register to read from)
+  for(uint8_t i = 0; i < ramBytes; i++) {
+    if(!sendI2cByte(I2CBB_Buffer[i])) {
+      abortTransaction();
+      return 0;
     }
-    
-    i++;
   }
+  
+  // switch to reading without releasing the bus
+  if(!sendI2cRepeatedStartSignal() || !sendI2cByte(I2CBB_Buffer[0] | I2CBB_RW_BIT_POSITION)) {
+    abortTransaction();
+    return 0;
+  }
+  
+  return receiveBytes(numBytesToRead, outputBuffer);
+}
+
 
+
+bool I2CBitBanger::probe() {
+  // let any asynchronous writes finish first
+  waitForIdle();
+  
+  if(!startTransaction()) {
+    return false;
+  }
+  
+  if(!sendI2cByte(I2CBB_Buffer[0] & ~(I2CBB_RW_BIT_POSITION))) {
+    abortTransaction();
+    return false;
+  }
+  
   sendI2cStopSignal();
+  I2CBB_SYNC_TRANSACTION_ENDED();
   
-  return i;
+  return true;
+}
+
+
+bool I2CBitBanger::waitForAck(uint16_t timeoutMs, unsigned long* waitedUs) {
+  unsigned long started = micros();
+  unsigned long waited = 0;
+  bool acked = false;
+  
+  for(;;) {
+    acked = probe();
+    waited = micros() - started;
+    if(acked || waited >= (unsigned long)timeoutMs * 1000UL) {
+      break;
+    }
+  }
+  
+  if(waitedUs != NULL) {
+    *waitedUs = waited;
+  }
+  
+  return acked;
+}
+
+
+bool I2CBitBanger::recoverBus() {
+  // let any asynchronous writes finish first
+  waitForIdle();
+  
+  busNeedsRecovery = false;
+  lastError = freeBus();
+  return lastError == I2CBB_OK;
+}
+
+
+uint8_t I2CBitBanger::getLastError() {
+  return lastError;
+}
+
+
+
+#if I2CBB_STATS
+
+void I2CBitBanger::setStatsCaller(uint8_t caller) {
+  statsCaller = (caller < I2CBB_STATS_CALLERS) ? caller : I2CBB_STATS_CALLERS - 1;
+}
+
+
+void I2CBitBanger::countRetry() {
+  stats.callers[statsCaller].retries++;
+}
+
+
+void I2CBitBanger::copyStats(uint8_t offset, uint8_t count, uint8_t* output) {
+  // with interrupts off, so an asynchronous transaction completing meanwhile can't tear a count
+  uint8_t oldSREG = SREG;
+  cli();
+  memcpy(output, (const uint8_t*)&stats + offset, count);
+  SREG = oldSREG;
+}
+
+
+void I2CBitBanger::clearStats() {
+  uint8_t oldSREG = SREG;
+  cli();
+  memset(&stats, 0, sizeof(stats));
+  SREG = oldSREG;
+}
+
+
+void I2CBitBanger::transactionStarted(uint8_t caller) {
+  stats.callers[caller].transactions++;
+  transactionStartUs = micros();
+}
+
+
+void I2CBitBanger::transactionEnded(uint8_t caller, bool nack, bool timeout) {
+  unsigned long busyUs = micros() - transactionStartUs;
+  I2CBBCallerStats* callerStats = &stats.callers[caller];
+  
+  callerStats->busyUs += busyUs;
+  if(nack) {
+    callerStats->nacks++;
+  }
+  if(timeout) {
+    callerStats->timeouts++;
+  }
+  
+  uint8_t bucket = 0;
+  while(bucket < I2CBB_HISTOGRAM_BUCKETS - 1 && busyUs >= ((unsigned long)I2CBB_HISTOGRAM_BASE_US << bucket)) {
+    bucket++;
+  }
+  stats.histogram[bucket]++;
+}
+
+#endif
+
+
+
+#if I2CBB_ASYNC_ENABLED
+
+void I2CBitBanger::submitTransaction(I2CBBTransaction* transaction) {
+  transaction->status = I2CBB_TRANSACTION_QUEUED;
+#if I2CBB_STATS
+  transaction->caller = statsCaller;
+#endif
+  
+  // wait for room in the queue
+  while( ((asyncQueueTail + 1) & (I2CBB_QUEUE_SIZE - 1)) == asyncQueueHead ) {
+    I2CBB_WAIT_HOOK();
+  }
+  
+  asyncQueue[asyncQueueTail] = transaction;
+  asyncQueueTail = (asyncQueueTail + 1) & (I2CBB_QUEUE_SIZE - 1);
+  
+  if(busNeedsRecovery && asyncState == ASYNC_IDLE) {
+    // the interrupt abandoned a transaction, recover the bus here rather than with interrupts off
+    busNeedsRecovery = false;
+    lastError = freeBus();
+  }
+  
+  uint8_t oldSREG = SREG;
+  cli();
+  
+  if(asyncState == ASYNC_IDLE) {
+    // start Timer1 in CTC mode, the first interrupt starts the transaction
+    asyncState = ASYNC_NEXT;
+    TCCR1A = 0;
+    TCCR1B = (1<<WGM12) | (1<<CS11); // CTC, F_CPU/8
+    OCR1A = 1;
+    TCNT1 = 0;
+    TIFR1 = (1<<OCF1A);
+    TIMSK1 |= (1<<OCIE1A);
+  }
+  
+  SREG = oldSREG;
 }
 
 
+bool I2CBitBanger::isIdle() {
+  return asyncState == ASYNC_IDLE;
+}
+
+
+void I2CBitBanger::waitForIdle() {
+  while(asyncState != ASYNC_IDLE) {
+    I2CBB_WAIT_HOOK();
+  }
+}
+
+#endif
+
+
 
 // Private functions
 
 
 bool I2CBitBanger::sendDataOverI2c(uint8_t* buffer, uint8_t bufferSize) {
 
-  sendI2cStartSignal();
+  if(!startTransaction()) {
+    return false;
+  }
 
   for(uint8_t i = 0; i < bufferSize; i++) {
     if(!sendI2cByte(buffer[i])) {
+      abortTransaction();
       return false;
     }
   }
 
   sendI2cStopSignal();
+  I2CBB_SYNC_TRANSACTION_ENDED();
 
   return true;
 }
 
 
+bool I2CBitBanger::startTransaction() {
+  // sends a START, once the bus is idle (a slave may have been left holding SDA or SCL low, e.g. by a reset mid transaction)
+  lastError = I2CBB_OK;
+  I2CBB_TRANSACTION_STARTED(statsCaller);
+  
+  if(busNeedsRecovery || (PIN_I2CBB & ((1<<SDA_BIT) | (1<<SCL_BIT))) != ((1<<SDA_BIT) | (1<<SCL_BIT))) {
+    busNeedsRecovery = false;
+    lastError = freeBus();
+    if(lastError != I2CBB_OK) {
+      I2CBB_SYNC_TRANSACTION_ENDED();
+      return false;
+    }
+  }
+  
+  sendI2cStartSignal();
+  return true;
+}
+
+
+void I2CBitBanger::abortTransaction() {
+  // leaves the bus idle after sendI2cByte or receiveI2cByte failed (lastError says why)
+  if(lastError == I2CBB_ERROR_NACK) {
+    // the NACK left SCL released, it has to be low before the STOP
+    DDR_I2CBB |= (1<<SCL_BIT); // set SCL low
+    _delay_us(i2cbbDelayUs(I2CBBActiveTiming::ackHold));
+    sendI2cStopSignal();
+  } else if(freeBus() != I2CBB_OK) {
+    lastError = I2CBB_ERROR_BUS_STUCK;
+  }
+  
+  I2CBB_SYNC_TRANSACTION_ENDED();
+}
+
+
+bool I2CBitBanger::waitWhileStretched() {
+  // waits (at most I2CBB_STRETCH_TIMEOUT_US) for a released SCL to go high.  returns false if the slave kept it low
+  if(PIN_I2CBB & (1<<SCL_BIT)) {
+    return true;
+  }
+  
+  for(uint16_t polls = 0; polls < STRETCH_POLLS; polls++) {
+    _delay_us(I2CBB_STRETCH_POLL_US);
+    if(PIN_I2CBB & (1<<SCL_BIT)) {
+      // the slave let go, give the clock a full high period from here
+      _delay_us(i2cbbDelayUs(I2CBBActiveTiming::clockHigh));
+      return true;
+    }
+  }
+  
+  return false;
+}
+
+
+uint8_t I2CBitBanger::freeBus() {
+  /*
+    Release SDA and SCL (waiting out any clock stretching)
+    While a slave holds SDA low, at most 9 times:
+      Set SCL low
+      Wait clockLow
+      Release SCL
+      Wait clockHigh (and out any clock stretching)
+    Set SCL low, send a STOP
+    return I2CBB_OK (or I2CBB_ERROR_BUS_STUCK if SCL or SDA never went high)
+  */
+  
+  DDR_I2CBB &= ~(1<<SDA_BIT); // release SDA
+  DDR_I2CBB &= ~(1<<SCL_BIT); // release SCL
+  _delay_us(i2cbbDelayUs(I2CBBActiveTiming::clockHigh));
+  if(!waitWhileStretched()) {
+    return I2CBB_ERROR_BUS_STUCK;
+  }
+  
+  // a slave that was interrupted mid byte lets go of SDA once it has clocked out the rest of it (and the ACK)
+  for(uint8_t i = 0; i < 9 && (PIN_I2CBB & (1<<SDA_BIT)) == 0x00; i++) {
+    DDR_I2CBB |= (1<<SCL_BIT); // set SCL low
+    _delay_us(i2cbbDelayUs(I2CBBActiveTiming::clockLow));
+    DDR_I2CBB &= ~(1<<SCL_BIT); // release SCL
+    _delay_us(i2cbbDelayUs(I2CBBActiveTiming::clockHigh));
+    if(!waitWhileStretched()) {
+      return I2CBB_ERROR_BUS_STUCK;
+    }
+  }
+  
+  if((PIN_I2CBB & (1<<SDA_BIT)) == 0x00) {
+    return I2CBB_ERROR_BUS_STUCK;
+  }
+  
+  // a STOP, so every slave knows the bus is idle
+  DDR_I2CBB |= (1<<SCL_BIT); // set SCL low
+  _delay_us(i2cbbDelayUs(I2CBBActiveTiming::clockLow));
+  sendI2cStopSignal();
+  
+  return I2CBB_OK;
+}
+
+
 void I2CBitBanger::sendI2cStartSignal() {
   /*
     Set SDA low
-    Wait 10.5us
+    Wait startHold
     Set SCL low
-    Wait 10.5us
+    Wait startToData
     return;
   */
   
   DDR_I2CBB |= (1<<SDA_BIT); // set SDA low
-  _delay_us(10);
+  _delay_us(i2cbbDelayUs(I2CBBActiveTiming::startHold));
   DDR_I2CBB |= (1<<SCL_BIT); // set SCL low
-  _delay_us(10);
+  _delay_us(i2cbbDelayUs(I2CBBActiveTiming::startToData));
 
   return;
 }
 
 
+bool I2CBitBanger::sendI2cRepeatedStartSignal() {
+  /*
+    (SCL is low and SDA is released after the previous ACK)
+    Release SCL
+    Wait repeatedStartSetup (and out any clock stretching)
+    Send a normal start signal
+    return true;
+  */
+  
+  DDR_I2CBB &= ~(1<<SDA_BIT); // release SDA
+  DDR_I2CBB &= ~(1<<SCL_BIT); // release SCL
+  _delay_us(i2cbbDelayUs(I2CBBActiveTiming::repeatedStartSetup));
+  if(!waitWhileStretched()) {
+    lastError = I2CBB_ERROR_TIMEOUT;
+    return false;
+  }
+  
+  sendI2cStartSignal();
+  
+  return true;
+}
+
+
 bool I2CBitBanger::sendI2cByte(uint8_t dataByte) {
     
   /*
     Loop 8 times to send 8 bits
       Set SDA to bit
-      Wait 1us
+      Wait dataSetup
       Release SCL
-      Wait 2.5us
+      Wait clockHigh (and out any clock stretching, if that times out return false)
       Set SCL low
-      Wait 6us
+      Wait clockLow
 
     Relase SDA
-    Wait 1us
+    Wait dataSetup
     Make SDA an input
     Release SCL
+    Wait clockHigh (and out any clock stretching, if that times out return false)
     Read the value of SDA
-    Wait 3.5us
     if(SDA was NACK) return false;
     Set SCL low
-    Wait 1us
     Make SDA an output (released)
-    Wait 15us
+    Wait ackHold
     return true;
   */
   
+  I2CBB_COUNT(statsCaller, bytesWritten);
+  
   // send each bit, MSB to LSB
   uint8_t mask = 0x80;
   for(int i = 0; i < 8; i++) {
@@ -169,32 +652,40 @@ bool I2CBitBanger::sendI2cByte(uint8_t dataByte) {
       // 0 
       DDR_I2CBB |= (1<<SDA_BIT); // set SDA low
     }
-    _delay_us(1);
+    _delay_us(i2cbbDelayUs(I2CBBActiveTiming::dataSetup));
     DDR_I2CBB &= ~(1<<SCL_BIT); // release SCL
-    _delay_us(3);
+    _delay_us(i2cbbDelayUs(I2CBBActiveTiming::clockHigh));
+    if(!waitWhileStretched()) {
+      lastError = I2CBB_ERROR_TIMEOUT;
+      return false;
+    }
     DDR_I2CBB |= (1<<SCL_BIT); // set SCL low
-    _delay_us(6);
+    _delay_us(i2cbbDelayUs(I2CBBActiveTiming::clockLow));
     
     mask = mask >> 1;
   }
   
   DDR_I2CBB &= ~(1<<SDA_BIT); // release SDA
-  _delay_us(1);
+  _delay_us(i2cbbDelayUs(I2CBBActiveTiming::dataSetup));
   // make SDA an input (it already is)
   DDR_I2CBB &= ~(1<<SCL_BIT); // release SCL
   // read the value of SDA
-  _delay_us(3);
+  _delay_us(i2cbbDelayUs(I2CBBActiveTiming::clockHigh));
+  if(!waitWhileStretched()) {
+    lastError = I2CBB_ERROR_TIMEOUT;
+    return false;
+  }
   
   if( PIN_I2CBB & (1<<SDA_BIT) ) { // received a NACK
-    // SDA and SCL remain released
+    // SDA and SCL remain released (see abortTransaction)
+    lastError = I2CBB_ERROR_NACK;
     return false;
   }
   
   // received an ACK
   DDR_I2CBB |= (1<<SCL_BIT); // set SCL low
-  _delay_us(1);
   // SDA remains released
-  _delay_us(15);
+  _delay_us(i2cbbDelayUs(I2CBBActiveTiming::ackHold));
 
   return true;
 }
@@ -203,46 +694,80 @@ bool I2CBitBanger::sendI2cByte(uint8_t dataByte) {
 void I2CBitBanger::sendI2cStopSignal() {
   /*
     Set SDA low
-    Wait 10.5us
+    Wait stopLow
     Release SCL
-    Wait 11.5us
+    Wait stopSetup (and out any clock stretching)
     Relase SDA
-    Wait 50us
+    Wait busFree
     return;
   */
   
   DDR_I2CBB |= (1<<SDA_BIT); // set SDA low
-  _delay_us(10);
+  _delay_us(i2cbbDelayUs(I2CBBActiveTiming::stopLow));
   DDR_I2CBB &= ~(1<<SCL_BIT);  // release SCL
-  _delay_us(11);
+  _delay_us(i2cbbDelayUs(I2CBBActiveTiming::stopSetup));
+  waitWhileStretched(); // if that times out, the next transaction finds the bus isn't idle and recovers it
   DDR_I2CBB &= ~(1<<SDA_BIT);  // release SDA
-  _delay_us(50);
+  _delay_us(i2cbbDelayUs(I2CBBActiveTiming::busFree));
 
   return;
 }
 
 
 
-void I2CBitBanger::receiveI2cByte(bool sendAcknowledge, uint8_t* output) {
+int I2CBitBanger::receiveBytes(int numBytesToRead, uint8_t* outputBuffer) {
+  // reads the bytes of a read transaction (after the address has been ACKed) and ends it with a STOP
+  int i = 0;
+  while(i < numBytesToRead) {
+	
+    bool received;
+    if(i == (numBytesToRead-1)) {
+      // on the last byte, we send a NAK
+      received = receiveI2cByte(false, outputBuffer + i);
+
+    } else {
+      // read a byte, sending an ACK
+      received = receiveI2cByte(true, outputBuffer + i);
+    }
+    
+    if(!received) {
+      abortTransaction();
+      return i;
+    }
+    
+    i++;
+  }
+
+  sendI2cStopSignal();
+  I2CBB_SYNC_TRANSACTION_ENDED();
+  
+  return i;
+}
+
+
+bool I2CBitBanger::receiveI2cByte(bool sendAcknowledge, uint8_t* output) {
   /*
     Loop 8 times:
-      Wait 15us (with SCL low)
-      Release SCL (ensure release)
-      Wait 15.5us
+      Wait rxClockLow (with SCL low)
+      Release SCL (wait out any clock stretching, if that times out return false)
+      Wait rxClockHigh
       Set SCL low
 
-    Wait 25us
-    Release SCL (ensure release)
-    Wait 13us
+    Wait rxAckLow, drive ACK/NACK, wait rxAckSetup
+    Release SCL (wait out any clock stretching, if that times out return false)
+    Wait rxAckHigh
     Set SCL low
-    Wait 25us
+    Wait rxAckHold, release SDA, wait rxAckRelease
   */
 
   uint8_t mask = 0x80;
   for(int i = 0; i < 8; i++) {
-    _delay_us(15);
+    _delay_us(i2cbbDelayUs(I2CBBActiveTiming::rxClockLow));
     DDR_I2CBB &= ~(1<<SCL_BIT);  // release SCL
-    while( (PIN_I2CBB & (1<<SCL_BIT)) == 0x00 ); // ensure SCL is actually high now (accounts for clock stretching)
+    if(!waitWhileStretched()) { // ensure SCL is actually high now (accounts for clock stretching)
+      lastError = I2CBB_ERROR_TIMEOUT;
+      return false;
+    }
     
     // read the bit sent to us from the slave device
     if(PIN_I2CBB & (1<<SDA_BIT)) {
@@ -254,30 +779,201 @@ void I2CBitBanger::receiveI2cByte(bool sendAcknowledge, uint8_t* output) {
     }
     mask = mask >> 1;
     
-    _delay_us(15);
+    _delay_us(i2cbbDelayUs(I2CBBActiveTiming::rxClockHigh));
     DDR_I2CBB |= (1<<SCL_BIT); // set SCL low
   }
   
-  _delay_us(23);
+  _delay_us(i2cbbDelayUs(I2CBBActiveTiming::rxAckLow));
   if(sendAcknowledge) {
     // pull SDL low to send an ACK to the slave device
     DDR_I2CBB |= (1<<SDA_BIT); // set SDA low
   }
   
-  _delay_us(2);
+  _delay_us(i2cbbDelayUs(I2CBBActiveTiming::rxAckSetup));
   DDR_I2CBB &= ~(1<<SCL_BIT);  // release SCL
-  while( (PIN_I2CBB & (1<<SCL_BIT)) == 0x00 ); // ensure SCL is actually high now (accounts for clock stretching)
+  if(!waitWhileStretched()) { // ensure SCL is actually high now (accounts for clock stretching)
+    lastError = I2CBB_ERROR_TIMEOUT;
+    return false;
+  }
   
-  _delay_us(13);
+  _delay_us(i2cbbDelayUs(I2CBBActiveTiming::rxAckHigh));
   DDR_I2CBB |= (1<<SCL_BIT); // set SCL low
 
-  _delay_us(23);
+  _delay_us(i2cbbDelayUs(I2CBBActiveTiming::rxAckHold));
   DDR_I2CBB &= ~(1<<SDA_BIT);  // release SDA
-  _delay_us(2);
+  _delay_us(i2cbbDelayUs(I2CBBActiveTiming::rxAckRelease));
   
-  return;
+  I2CBB_COUNT(statsCaller, bytesRead);
+  return true;
+}
+
+
+
+#if I2CBB_ASYNC_ENABLED
+
+bool I2CBitBanger::loadNextAsyncByte() {
+  // loads the next byte of the current transaction into asyncByte, returns false if there are none left
+  I2CBBTransaction* transaction = asyncQueue[asyncQueueHead];
+  
+  if(asyncByteIndex == 0) {
+    asyncByte = I2CBB_Buffer[0] & ~(I2CBB_RW_BIT_POSITION); // slave address, write
+  } else if(asyncByteIndex == 1) {
+    asyncByte = transaction->firstRegister;
+  } else if((asyncByteIndex - 2) < transaction->length) {
+    const uint8_t* data = transaction->data + (asyncByteIndex - 2);
+    if(transaction->source != NULL) {
+      asyncByte = transaction->source();
+    } else {
+      asyncByte = transaction->dataInProgmem ? pgm_read_byte(data) : *data;
+    }
+  } else {
+    return false;
+  }
+  
+  I2CBB_COUNT(transaction->caller, bytesWritten);
+  asyncByteIndex++;
+  asyncBitMask = 0x80;
+  return true;
 }
 
 
+void I2CBitBanger::completeAsyncTransaction() {
+  // records the outcome of the transaction at the head of the queue and moves on to the next one
+  I2CBB_TRANSACTION_ENDED(asyncQueue[asyncQueueHead]->caller, asyncResult == I2CBB_TRANSACTION_FAILED,
+                          asyncResult == I2CBB_TRANSACTION_TIMEOUT);
+  asyncQueue[asyncQueueHead]->status = asyncResult;
+  asyncQueueHead = (asyncQueueHead + 1) & (I2CBB_QUEUE_SIZE - 1);
+}
+
 
+void I2CBitBanger::handleTimerInterrupt() {
+  /*
+    Same sequence (and timing profile) as sendI2cStartSignal, sendI2cByte and sendI2cStopSignal,
+    one bus phase per state.  A NACK ends the transaction with a STOP.
+    Before SCL is pulled low again, ASYNC_STRETCH polls it (from Timer1) for as long as the slave stretches it.
+    If that times out, or the bus isn't idle before a START, the transaction and the rest of the queue end with
+    I2CBB_TRANSACTION_TIMEOUT.  The bus isn't recovered here (freeBus could busy-wait for about 10 stretch timeouts
+    with interrupts off), but by the next transaction the sketch starts (busNeedsRecovery).
+  */
+  
+  for(;;) {
+    switch(asyncState) {
+      
+      case ASYNC_NEXT:
+        if(asyncQueueHead == asyncQueueTail) {
+          // nothing left to send, stop the timer
+          TIMSK1 &= ~(1<<OCIE1A);
+          TCCR1B = 0;
+          asyncState = ASYNC_IDLE;
+          return;
+        }
+        
+        asyncByteIndex = 0;
+        asyncResult = I2CBB_TRANSACTION_DONE;
+        I2CBB_TRANSACTION_STARTED(asyncQueue[asyncQueueHead]->caller);
+        loadNextAsyncByte();
+        
+        if(busNeedsRecovery || (PIN_I2CBB & ((1<<SDA_BIT) | (1<<SCL_BIT))) != ((1<<SDA_BIT) | (1<<SCL_BIT))) {
+          // a slave is holding the bus (or was left mid byte), don't even start
+          busNeedsRecovery = true;
+          asyncResult = I2CBB_TRANSACTION_TIMEOUT;
+          completeAsyncTransaction();
+          break;
+        }
+        
+        DDR_I2CBB |= (1<<SDA_BIT); // set SDA low (start)
+        I2CBB_ASYNC_WAIT(startHold, ASYNC_START_SCL_LOW);
+        break;
+        
+      case ASYNC_START_SCL_LOW:
+        DDR_I2CBB |= (1<<SCL_BIT); // set SCL low
+        I2CBB_ASYNC_WAIT(startToData, ASYNC_BIT);
+        break;
+        
+      case ASYNC_BIT:
+        if(asyncByte & asyncBitMask) {
+          DDR_I2CBB &= ~(1<<SDA_BIT); // release SDA
+        } else {
+          DDR_I2CBB |= (1<<SDA_BIT); // set SDA low
+        }
+        I2CBB_ASYNC_WAIT(dataSetup, ASYNC_BIT_SCL_HIGH);
+        break;
+        
+      case ASYNC_BIT_SCL_HIGH:
+        DDR_I2CBB &= ~(1<<SCL_BIT); // release SCL
+        I2CBB_ASYNC_WAIT(clockHigh, ASYNC_BIT_SCL_LOW);
+        break;
+        
+      case ASYNC_BIT_SCL_LOW:
+        I2CBB_ASYNC_CHECK_STRETCH(ASYNC_BIT_SCL_LOW);
+        DDR_I2CBB |= (1<<SCL_BIT); // set SCL low
+        asyncBitMask = asyncBitMask >> 1;
+        I2CBB_ASYNC_WAIT(clockLow, (asyncBitMask != 0) ? ASYNC_BIT : ASYNC_ACK);
+        break;
+        
+      case ASYNC_ACK:
+        DDR_I2CBB &= ~(1<<SDA_BIT); // release SDA
+        I2CBB_ASYNC_WAIT(dataSetup, ASYNC_ACK_SCL_HIGH);
+        break;
+        
+      case ASYNC_ACK_SCL_HIGH:
+        DDR_I2CBB &= ~(1<<SCL_BIT); // release SCL
+        I2CBB_ASYNC_WAIT(clockHigh, ASYNC_ACK_SAMPLE);
+        break;
+        
+      case ASYNC_ACK_SAMPLE:
+        I2CBB_ASYNC_CHECK_STRETCH(ASYNC_ACK_SAMPLE);
+        if( PIN_I2CBB & (1<<SDA_BIT) ) { // received a NACK
+          asyncResult = I2CBB_TRANSACTION_FAILED;
+        }
+        
+        DDR_I2CBB |= (1<<SCL_BIT); // set SCL low
+        I2CBB_ASYNC_WAIT(ackHold, (asyncResult == I2CBB_TRANSACTION_DONE && loadNextAsyncByte()) ? ASYNC_BIT : ASYNC_STOP);
+        break;
+        
+      case ASYNC_STOP:
+        DDR_I2CBB |= (1<<SDA_BIT); // set SDA low
+        I2CBB_ASYNC_WAIT(stopLow, ASYNC_STOP_SCL_HIGH);
+        break;
+        
+      case ASYNC_STOP_SCL_HIGH:
+        DDR_I2CBB &= ~(1<<SCL_BIT);  // release SCL
+        I2CBB_ASYNC_WAIT(stopSetup, ASYNC_STOP_SDA_HIGH);
+        break;
+        
+      case ASYNC_STOP_SDA_HIGH:
+        I2CBB_ASYNC_CHECK_STRETCH(ASYNC_STOP_SDA_HIGH);
+        DDR_I2CBB &= ~(1<<SDA_BIT);  // release SDA
+        
+        completeAsyncTransaction();
+        I2CBB_ASYNC_WAIT(busFree, ASYNC_NEXT);
+        break;
+        
+      case ASYNC_STRETCH:
+        if(PIN_I2CBB & (1<<SCL_BIT)) {
+          // the slave let go, give the clock a full high period from here
+          I2CBB_ASYNC_WAIT(clockHigh, asyncStretchReturnState);
+          break;
+        }
+        
+        if(asyncStretchPolls == 0) {
+          // the slave held SCL for too long, give up on the transaction and let go of the bus
+          DDR_I2CBB &= ~((1<<SDA_BIT) | (1<<SCL_BIT));
+          busNeedsRecovery = true;
+          asyncResult = I2CBB_TRANSACTION_TIMEOUT;
+          completeAsyncTransaction();
+          asyncState = ASYNC_NEXT;
+          break;
+        }
+        
+        asyncStretchPolls--;
+        I2CBB_ASYNC_WAIT_US(I2CBB_ASYNC_MIN_US, ASYNC_STRETCH);
+        break;
+        
+      default:
+        return;
+    }
+  }
+}
 
+#endif
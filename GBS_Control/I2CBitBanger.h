@@ -3,6 +3,7 @@
   Only supports writing at the moment
   Developed specifically to write register values to the GBS 8220
   Timing is based on the timing observed with the GBS 8220's onboard microcontroller
+  (other timing profiles can be selected in I2CBitBangerTiming.h)
 
   This is (somewhat) based off of the TinyWireM and USI_TWI_Master interface
 */
@@ -12,6 +13,7 @@
 
 #include <inttypes.h>
 #include <Arduino.h>
+#include "I2CBitBangerTiming.h"
 
 #define I2CBB_RW_BIT_POSITION 0x01
 #define I2CBB_BUF_SIZE    33             // bytes in message buffer (holds a slave address and 32 bytes
@@ -25,6 +27,89 @@
 #define I2C_ACK 0
 #define I2C_NACK 1
 
+// Longest the slave may hold SCL low (clock stretching) on one clock before the transaction is
+// abandoned and the bus recovered.  This bounds every bus operation: a transaction never takes longer
+// than its normal duration plus one stretch timeout and a bus recovery (9 clocks, each also bounded).
+#ifndef I2CBB_STRETCH_TIMEOUT_US
+#define I2CBB_STRETCH_TIMEOUT_US 1000
+#endif
+#define I2CBB_STRETCH_POLL_US 1          // how often SCL is checked while it is stretched
+
+// getLastError() values
+#define I2CBB_OK               0
+#define I2CBB_ERROR_NACK       1         // the slave NACKed, a STOP was sent
+#define I2CBB_ERROR_TIMEOUT    2         // SCL was stretched for longer than I2CBB_STRETCH_TIMEOUT_US, the bus was recovered
+#define I2CBB_ERROR_BUS_STUCK  3         // a slave kept SCL or SDA low even through a bus recovery
+
+// Asynchronous (timer interrupt driven) writes.  Uses Timer1, set to 0 if Timer1 is needed elsewhere.
+#ifndef I2CBB_ASYNC_ENABLED
+#define I2CBB_ASYNC_ENABLED 1
+#endif
+
+// Called while waiting for the asynchronous writes, lets a host simulation run the timer (nothing on the AVR)
+#ifndef I2CBB_WAIT_HOOK
+#define I2CBB_WAIT_HOOK()
+#endif
+
+#define I2CBB_QUEUE_SIZE 4               // one more than the transactions that can be waiting at once (must be a power of 2)
+#define I2CBB_ASYNC_PRESCALER 8          // Timer1 runs at F_CPU/8
+#define I2CBB_ASYNC_MIN_US 4             // bus phases shorter than this are busy-waited inside the interrupt
+
+// Instrumentation: counts of the transactions, bytes, NACKs, timeouts and retries and the bus busy time of each
+// caller (set with setStatsCaller), and a histogram of how long the transactions took.  Costs about 130 bytes of RAM
+// and a micros() call at each START and STOP, so it is compiled out unless I2CBB_STATS is 1.
+#ifndef I2CBB_STATS
+#define I2CBB_STATS 0
+#endif
+#define I2CBB_STATS_CALLERS 5            // caller numbers 0 - 4
+#define I2CBB_HISTOGRAM_BUCKETS 8
+#define I2CBB_HISTOGRAM_BASE_US 128      // bucket n counts transactions shorter than I2CBB_HISTOGRAM_BASE_US << n (the last one the rest)
+
+// I2CBBTransaction status values
+#define I2CBB_TRANSACTION_QUEUED 0
+#define I2CBB_TRANSACTION_DONE   1
+#define I2CBB_TRANSACTION_FAILED 2       // the slave NACKed, a STOP was still sent
+#define I2CBB_TRANSACTION_TIMEOUT 3      // SCL was stretched for too long (or the bus was stuck), the rest of the queue fails
+                                         // too and the bus is recovered by the next transaction started outside the interrupt
+
+
+// Supplies the bytes of a write one at a time (e.g. a decompressor), called as each byte is about to be sent
+typedef uint8_t (*I2CBBByteSource)();
+
+// An asynchronous register write: the slave address, firstRegister, then length bytes from data
+// (or from source, if it isn't NULL; it is then called from the Timer1 interrupt).
+// The transaction must stay in scope until its status is no longer I2CBB_TRANSACTION_QUEUED.
+struct I2CBBTransaction {
+  uint8_t firstRegister;
+  const uint8_t* data;
+  uint16_t length;
+  bool dataInProgmem;
+  I2CBBByteSource source;
+  volatile uint8_t status;
+#if I2CBB_STATS
+  uint8_t caller;                        // set by submitTransaction
+#endif
+};
+
+#if I2CBB_STATS
+// What was counted for one caller since the counts were last cleared (the counts wrap around).
+// Packed so the layout is the same on a host build (the register console sends it as it is).
+struct __attribute__((packed)) I2CBBCallerStats {
+  uint32_t transactions;   // START ... STOP (or attempts to start one on a stuck bus), a repeated START doesn't count
+  uint32_t bytesWritten;   // including slave addresses
+  uint32_t bytesRead;
+  uint32_t busyUs;         // START to STOP
+  uint16_t nacks;          // transactions that ended with a NACK
+  uint16_t timeouts;       // transactions that ended with a stretch timeout or a stuck bus
+  uint16_t retries;        // counted by the caller with countRetry
+};
+
+struct __attribute__((packed)) I2CBBStats {
+  I2CBBCallerStats callers[I2CBB_STATS_CALLERS];
+  uint16_t histogram[I2CBB_HISTOGRAM_BUCKETS];  // transaction durations of all callers
+};
+#endif
+
 
 /*
       Normal interface usage pseudo code is as follows:
@@ -38,6 +123,18 @@
       else
         success
       
+      To Write From Flash (e.g. a register address followed by a PROGMEM table):
+      
+      test.addByteForTransmission(<register>);
+      if(!test.transmitDataFromProgmem(<PROGMEM pointer>, <number of bytes>))
+        failed to send data
+      
+      To Write Generated Bytes (e.g. decompressed as they are sent):
+      
+      test.addByteForTransmission(<register>);
+      if(!test.transmitDataFromSource(<function returning the next byte>, <number of bytes>))
+        failed to send data
+      
       To Read:
       
       uint8_t recevedData[4];
@@ -47,6 +144,39 @@
         failed to read data
       }
       
+      To Read From A Register (repeated START, no STOP in between):
+      
+      test.addByteForTransmission(<register>);
+      int bytesReceived = test.writeThenRead(4, receivedData);
+      if(bytesReceived != 4) {
+        failed to read data
+      }
+      
+      To Write Without Waiting (the bytes are clocked out from a timer interrupt):
+      
+      I2CBBTransaction transaction = { <register>, <data pointer>, <number of bytes>, <true if data is PROGMEM>, <byte source or NULL> };
+      test.submitTransaction(&transaction);
+      ... do other work ...
+      if(transaction.status == I2CBB_TRANSACTION_DONE)
+        success
+      
+      The other functions wait for the submitted transactions to finish before using the bus.
+      
+      To Wait Until The Slave Answers (e.g. after power up):
+      
+      unsigned long waitedUs;
+      if(!test.waitForAck(<timeout in ms>, &waitedUs))
+        the slave didn't ACK its address within the timeout
+      
+      Every function that returns false (or fewer bytes than asked for) leaves the bus idle
+      (a STOP was sent, or the bus was recovered) and the reason in getLastError().
+      
+      To Count What Each Part Of A Sketch Does On The Bus (I2CBB_STATS set to 1):
+      
+      test.setStatsCaller(<caller number>);
+      ... transactions (and countRetry() for each transfer that is sent again) ...
+      test.copyStats(0, sizeof(I2CBBStats), <buffer>);
+      
       To Change The Slave Address:
       
       test.setSlaveAddress(<7-bit address>);
@@ -67,21 +197,104 @@ class I2CBitBanger
     void addBytesForTransmission(uint8_t* buffer, uint8_t bufferSize);
     
     bool transmitData();  // returns true if transmission was successful (everything ACKed by the slave device)
+    
+    // Sends the internally managed transmission buffer followed by bufferSize bytes read directly from flash (PROGMEM),
+    // all in one transaction.  There is no limit on bufferSize since nothing is copied into RAM.
+    bool transmitDataFromProgmem(const uint8_t* progmemBuffer, uint16_t bufferSize);  // returns true if everything was ACKed
+    
+    // As above, but the bufferSize bytes after the internally managed transmission buffer come from source
+    bool transmitDataFromSource(I2CBBByteSource source, uint16_t bufferSize);  // returns true if everything was ACKed
     int recvData(int numBytesToRead, uint8_t* outputBuffer);  // returns the number of bytes that were read
     
+    // Sends the internally managed transmission buffer (e.g. a register address), then a repeated START
+    // and reads numBytesToRead bytes in the same transaction.  The slave's auto-increment applies to multi-byte reads.
+    int writeThenRead(int numBytesToRead, uint8_t* outputBuffer);  // returns the number of bytes that were read
+    
+    // Sends only the slave address (write) and a STOP, returns true if the slave ACKed
+    bool probe();
+    
+    // ACK polling: probes the slave until it ACKs or timeoutMs have passed.  returns true if it ACKed,
+    // waitedUs (if not NULL) is set to how long that took
+    bool waitForAck(uint16_t timeoutMs, unsigned long* waitedUs);
+    
+    // Clocks SCL (up to 9 times) until a slave stuck in the middle of a byte releases SDA, then sends a STOP.
+    // Called automatically after a timeout and before a transaction if the bus isn't idle.  returns true if the bus is idle
+    bool recoverBus();
+    
+    uint8_t getLastError();  // I2CBB_OK or the I2CBB_ERROR_ value of the last failed operation
+    
+#if I2CBB_ASYNC_ENABLED
+    // Queues a write to be sent from the Timer1 interrupt and returns straight away
+    // (waits only if the queue is full).  The transaction's status is updated when it completes.
+    void submitTransaction(I2CBBTransaction* transaction);
+    
+    bool isIdle();       // true if no submitted transactions are queued or in progress
+    void waitForIdle();  // waits until all submitted transactions have completed
+    
+    static void handleTimerInterrupt(); // called from the Timer1 compare interrupt, not for use by sketches
+#else
+    void waitForIdle() {}
+#endif
+    
+#if I2CBB_STATS
+    static void setStatsCaller(uint8_t caller);  // the following transactions (and retries) are counted for caller
+    static uint8_t getStatsCaller() { return statsCaller; }
+    static void countRetry();                    // the current caller is sending a failed transfer again
+    static void copyStats(uint8_t offset, uint8_t count, uint8_t* output);  // count bytes of the I2CBBStats from offset
+    static void clearStats();
+#else
+    static void setStatsCaller(uint8_t /*caller*/) {}
+    static uint8_t getStatsCaller() { return 0; }
+    static void countRetry() {}
+#endif
+    
 
   private:
     static uint8_t I2CBB_Buffer[];           // holds I2C send data
     static uint8_t I2CBB_BufferIndex;        // current number of bytes in the send buff
 
+    static uint8_t lastError;                // I2CBB_OK or I2CBB_ERROR_...
+    static volatile bool busNeedsRecovery;   // an asynchronous transaction was abandoned, freeBus before the next one
+
     void initializePins();
     
     bool sendDataOverI2c(uint8_t* buffer, uint8_t bufferSize);
+    bool startTransaction();
+    void abortTransaction();
     void sendI2cStartSignal();
+    bool sendI2cRepeatedStartSignal();
     bool sendI2cByte(uint8_t dataByte);
-    void sendI2cStopSignal();
+    static void sendI2cStopSignal();
+    static bool waitWhileStretched();
+    static uint8_t freeBus();
+    
+    int receiveBytes(int numBytesToRead, uint8_t* outputBuffer);
+    bool receiveI2cByte(bool sendAcknowledge, uint8_t* output);
     
-    void receiveI2cByte(bool sendAcknowledge, uint8_t* output);
+#if I2CBB_STATS
+    static I2CBBStats stats;
+    static uint8_t statsCaller;
+    static unsigned long transactionStartUs;
+    
+    static void transactionStarted(uint8_t caller);
+    static void transactionEnded(uint8_t caller, bool nack, bool timeout);
+#endif
+    
+#if I2CBB_ASYNC_ENABLED
+    static I2CBBTransaction* volatile asyncQueue[];  // submitted transactions (ring buffer)
+    static volatile uint8_t asyncQueueHead;           // next transaction to send
+    static volatile uint8_t asyncQueueTail;           // where the next submitted transaction goes
+    static volatile uint8_t asyncState;
+    static uint16_t asyncByteIndex;                   // 0 = address, 1 = register, 2.. = data
+    static uint8_t asyncByte;
+    static uint8_t asyncBitMask;
+    static uint8_t asyncResult;                       // I2CBB_TRANSACTION_DONE so far, or how the transaction failed
+    static uint8_t asyncStretchReturnState;           // where to carry on once SCL is no longer stretched
+    static uint16_t asyncStretchPolls;                // polls left before the stretch times out
+    
+    static bool loadNextAsyncByte();
+    static void completeAsyncTransaction();
+#endif
 };
 
 #endif
@@ -0,0 +1,180 @@
+/*
+  Compile time I2C timing profiles for I2CBitBanger
+
+  Every delay I2CBitBanger makes on the bus comes from one of the profiles below.
+  The profile is selected by defining I2CBB_TIMING_PROFILE before this file is included
+  (or by changing the default below):
+
+    I2CBB_PROFILE_GBS       timing observed with the GBS 8220's onboard microcontroller (default)
+    I2CBB_PROFILE_STANDARD  I2C standard mode, 100 kHz
+    I2CBB_PROFILE_FAST      I2C fast mode, 400 kHz
+
+  Each phase is given as the time (in microseconds) the bus should stay in that state.
+  The cycles spent changing the line before a delay are taken off at compile time using F_CPU.
+
+  All profiles are checked against the I2C specification minimums with static_assert, so the
+  timing can also be checked on the host without any AVR tools, e.g. for a 16 MHz Digispark Pro:
+
+    g++ -std=c++11 -fsyntax-only -DF_CPU=16000000UL -x c++ I2CBitBangerTiming.h
+*/
+
+#ifndef I2CBitBangerTiming_h
+#define I2CBitBangerTiming_h
+
+#include <inttypes.h>
+
+#define I2CBB_PROFILE_GBS      0
+#define I2CBB_PROFILE_STANDARD 1
+#define I2CBB_PROFILE_FAST     2
+
+#ifndef I2CBB_TIMING_PROFILE
+#define I2CBB_TIMING_PROFILE I2CBB_PROFILE_GBS
+#endif
+
+// cycles taken by the sbi/cbi instruction that changes SDA or SCL before each delay
+#define I2CBB_LINE_CHANGE_CYCLES 2
+
+
+// I2C specification minimums (microseconds)
+struct I2CBBStandardModeSpec {
+  static constexpr double startHold = 4.0;          // tHD;STA
+  static constexpr double clockLow = 4.7;           // tLOW
+  static constexpr double clockHigh = 4.0;          // tHIGH
+  static constexpr double repeatedStartSetup = 4.7; // tSU;STA
+  static constexpr double dataSetup = 0.25;         // tSU;DAT
+  static constexpr double stopSetup = 4.0;          // tSU;STO
+  static constexpr double busFree = 4.7;            // tBUF
+  static constexpr uint32_t maxClockHz = 100000;    // fSCL
+};
+
+struct I2CBBFastModeSpec {
+  static constexpr double startHold = 0.6;
+  static constexpr double clockLow = 1.3;
+  static constexpr double clockHigh = 0.6;
+  static constexpr double repeatedStartSetup = 0.6;
+  static constexpr double dataSetup = 0.1;
+  static constexpr double stopSetup = 0.6;
+  static constexpr double busFree = 1.3;
+  static constexpr uint32_t maxClockHz = 400000;
+};
+
+
+template<uint8_t profile> struct I2CBBTiming;
+
+template<> struct I2CBBTiming<I2CBB_PROFILE_GBS> {
+  // The GBS MCU holds SCL high for only 3us, so this profile is only within the fast mode limits
+  typedef I2CBBFastModeSpec Spec;
+
+  static constexpr double startHold = 10;          // SDA low -> SCL low
+  static constexpr double startToData = 10;        // SCL low after a start
+  static constexpr double dataSetup = 1;           // SDA set -> SCL released
+  static constexpr double clockHigh = 3;           // SCL high while sending a bit or reading an ACK
+  static constexpr double clockLow = 6;            // SCL low after sending a bit
+  static constexpr double ackHold = 16;            // SCL low after an ACK was received
+  static constexpr double stopLow = 10;            // SDA low -> SCL released
+  static constexpr double stopSetup = 11;          // SCL released -> SDA released
+  static constexpr double busFree = 50;            // after a stop
+  static constexpr double repeatedStartSetup = 10; // SCL released -> SDA low
+  static constexpr double rxClockLow = 15;         // SCL low before reading a bit
+  static constexpr double rxClockHigh = 15;        // SCL high while reading a bit
+  static constexpr double rxAckLow = 23;           // SCL low before driving the ACK/NACK
+  static constexpr double rxAckSetup = 2;          // ACK/NACK driven -> SCL released
+  static constexpr double rxAckHigh = 13;          // SCL high during the ACK/NACK
+  static constexpr double rxAckHold = 23;          // SCL low -> SDA released
+  static constexpr double rxAckRelease = 2;        // after SDA is released
+};
+
+template<> struct I2CBBTiming<I2CBB_PROFILE_STANDARD> {
+  typedef I2CBBStandardModeSpec Spec;
+
+  static constexpr double startHold = 5;
+  static constexpr double startToData = 5;
+  static constexpr double dataSetup = 1;
+  static constexpr double clockHigh = 5;
+  static constexpr double clockLow = 4;
+  static constexpr double ackHold = 4;
+  static constexpr double stopLow = 5;
+  static constexpr double stopSetup = 5;
+  static constexpr double busFree = 5;
+  static constexpr double repeatedStartSetup = 5;
+  static constexpr double rxClockLow = 5;
+  static constexpr double rxClockHigh = 5;
+  static constexpr double rxAckLow = 4;
+  static constexpr double rxAckSetup = 1;
+  static constexpr double rxAckHigh = 5;
+  static constexpr double rxAckHold = 4;
+  static constexpr double rxAckRelease = 1;
+};
+
+template<> struct I2CBBTiming<I2CBB_PROFILE_FAST> {
+  typedef I2CBBFastModeSpec Spec;
+
+  static constexpr double startHold = 1;
+  static constexpr double startToData = 1.3;
+  static constexpr double dataSetup = 0.3;
+  static constexpr double clockHigh = 1;
+  static constexpr double clockLow = 1.2;
+  static constexpr double ackHold = 1.2;
+  static constexpr double stopLow = 1.3;
+  static constexpr double stopSetup = 1;
+  static constexpr double busFree = 1.5;
+  static constexpr double repeatedStartSetup = 1;
+  static constexpr double rxClockLow = 1.5;
+  static constexpr double rxClockHigh = 1;
+  static constexpr double rxAckLow = 1.2;
+  static constexpr double rxAckSetup = 0.3;
+  static constexpr double rxAckHigh = 1;
+  static constexpr double rxAckHold = 1.2;
+  static constexpr double rxAckRelease = 0.3;
+};
+
+typedef I2CBBTiming<I2CBB_TIMING_PROFILE> I2CBBActiveTiming;
+
+
+// Argument for _delay_us that makes a phase last phaseUs, given the cycles already spent changing the line
+constexpr double i2cbbDelayUs(double phaseUs) {
+  return (phaseUs - (I2CBB_LINE_CHANGE_CYCLES * 1000000.0 / F_CPU)) > 0.0 ?
+         (phaseUs - (I2CBB_LINE_CHANGE_CYCLES * 1000000.0 / F_CPU)) : 0.0;
+}
+
+// Minimum number of cycles a phase lasts (_delay_us never delays less than asked for)
+constexpr double i2cbbPhaseCycles(double phaseUs) {
+  return (i2cbbDelayUs(phaseUs) * F_CPU / 1000000.0) + I2CBB_LINE_CHANGE_CYCLES;
+}
+
+constexpr double i2cbbSpecCycles(double specUs) {
+  return specUs * F_CPU / 1000000.0;
+}
+
+
+// Compile time check of one profile against the bus mode it claims to meet
+template<uint8_t profile> struct I2CBBTimingCheck {
+  typedef I2CBBTiming<profile> T;
+  typedef typename T::Spec S;
+
+  static_assert(i2cbbPhaseCycles(T::startHold) >= i2cbbSpecCycles(S::startHold), "start hold time (tHD;STA) too short");
+  static_assert(i2cbbPhaseCycles(T::startToData) + i2cbbPhaseCycles(T::dataSetup) >= i2cbbSpecCycles(S::clockLow), "SCL low period after a start (tLOW) too short");
+  static_assert(i2cbbPhaseCycles(T::dataSetup) >= i2cbbSpecCycles(S::dataSetup), "data setup time (tSU;DAT) too short");
+  static_assert(i2cbbPhaseCycles(T::clockHigh) >= i2cbbSpecCycles(S::clockHigh), "SCL high period (tHIGH) too short");
+  static_assert(i2cbbPhaseCycles(T::clockLow) + i2cbbPhaseCycles(T::dataSetup) >= i2cbbSpecCycles(S::clockLow), "SCL low period (tLOW) too short");
+  static_assert(i2cbbPhaseCycles(T::ackHold) + i2cbbPhaseCycles(T::dataSetup) >= i2cbbSpecCycles(S::clockLow), "SCL low period after an ACK (tLOW) too short");
+  static_assert(i2cbbPhaseCycles(T::ackHold) + i2cbbPhaseCycles(T::stopLow) >= i2cbbSpecCycles(S::clockLow), "SCL low period before a stop (tLOW) too short");
+  static_assert(i2cbbPhaseCycles(T::stopSetup) >= i2cbbSpecCycles(S::stopSetup), "stop setup time (tSU;STO) too short");
+  static_assert(i2cbbPhaseCycles(T::busFree) >= i2cbbSpecCycles(S::busFree), "bus free time (tBUF) too short");
+  static_assert(i2cbbPhaseCycles(T::repeatedStartSetup) >= i2cbbSpecCycles(S::repeatedStartSetup), "repeated start setup time (tSU;STA) too short");
+  static_assert(i2cbbPhaseCycles(T::rxClockLow) >= i2cbbSpecCycles(S::clockLow), "SCL low period while reading (tLOW) too short");
+  static_assert(i2cbbPhaseCycles(T::rxClockHigh) >= i2cbbSpecCycles(S::clockHigh), "SCL high period while reading (tHIGH) too short");
+  static_assert(i2cbbPhaseCycles(T::rxAckLow) + i2cbbPhaseCycles(T::rxAckSetup) >= i2cbbSpecCycles(S::clockLow), "SCL low period before an ACK (tLOW) too short");
+  static_assert(i2cbbPhaseCycles(T::rxAckSetup) >= i2cbbSpecCycles(S::dataSetup), "ACK setup time (tSU;DAT) too short");
+  static_assert(i2cbbPhaseCycles(T::rxAckHigh) >= i2cbbSpecCycles(S::clockHigh), "SCL high period of an ACK (tHIGH) too short");
+  static_assert(i2cbbPhaseCycles(T::dataSetup) + i2cbbPhaseCycles(T::clockHigh) + i2cbbPhaseCycles(T::clockLow) >= ((double)F_CPU / S::maxClockHz), "SCL frequency too high while sending");
+  static_assert(i2cbbPhaseCycles(T::rxClockLow) + i2cbbPhaseCycles(T::rxClockHigh) >= ((double)F_CPU / S::maxClockHz), "SCL frequency too high while reading");
+
+  static constexpr bool passed = true;
+};
+
+static_assert(I2CBBTimingCheck<I2CBB_PROFILE_GBS>::passed, "GBS timing profile does not meet the I2C specification");
+static_assert(I2CBBTimingCheck<I2CBB_PROFILE_STANDARD>::passed, "standard mode timing profile does not meet the I2C specification");
+static_assert(I2CBBTimingCheck<I2CBB_PROFILE_FAST>::passed, "fast mode timing profile does not meet the I2C specification");
+
+#endif
@@ -0,0 +1,127 @@
+
+#include "I2CSniffer.h"
+#include <avr/interrupt.h>
+
+#define BUS_MASK ((1<<SDA_BIT) | (1<<SCL_BIT))
+
+// bytes a decoded event can add to the ring buffer (a data byte and a NACK)
+#define EVENT_MAX_BYTES 4
+
+
+I2CSniffer::I2CSniffer() {
+}
+
+
+void I2CSniffer::initializeUart() {
+  // LIN/UART in UART mode, 8N1, transmitter only, 8 samples per bit
+  LINCR = (1<<LSWRES);
+  LINBTR = (1<<LDISR) | 8;
+  LINBRR = (F_CPU / (8 * I2CSNIFF_BAUD)) - 1;
+  LINENIR = 0;
+  LINCR = (1<<LENA) | (1<<LCMD2) | (1<<LCMD0);
+}
+
+
+void I2CSniffer::run() {
+  /*
+    Forever:
+      Read the bus
+      If SCL went high:
+        Take the value of SDA as the next bit (the 9th bit of a byte is the ACK)
+        Queue the byte once it is complete (and a NACK if it got one)
+      Else if SDA changed while SCL stayed high:
+        Queue a START (SDA fell) or a STOP (SDA rose)
+      If the UART is free, send it the next queued byte
+  */
+
+  // never drive the bus
+  DDR_I2CBB &= ~BUS_MASK;
+  PORT_I2CBB &= ~BUS_MASK;
+
+  initializeUart();
+
+  // nothing else may take the CPU away from the loop
+  cli();
+
+  uint8_t head = 0;          // next byte to send
+  uint8_t tail = 0;          // where the next queued byte goes
+  bool uartBusy = false;
+  bool lost = false;         // an event didn't fit in the ring buffer
+  bool inTransfer = false;   // between a START and a STOP
+  uint8_t bitCount = 0;      // bits of the current byte seen so far (the 9th is the ACK)
+  uint8_t value = 0;
+  uint8_t previous = PIN_I2CBB & BUS_MASK;
+
+  for(;;) {
+    uint8_t lines = PIN_I2CBB & BUS_MASK;
+
+    if(lines != previous) {
+      uint8_t room = (head - tail - 1) & (I2CSNIFF_BUF_SIZE - 1);
+
+      if((lines & (1<<SCL_BIT)) && !(previous & (1<<SCL_BIT))) {
+        // SCL rising edge, SDA holds a bit
+        if(inTransfer) {
+          if(bitCount < 8) {
+            value = (value << 1) | ((lines >> SDA_BIT) & 0x01);
+            bitCount++;
+          } else {
+            // the ACK bit, the byte is complete
+            bitCount = 0;
+            if(room < EVENT_MAX_BYTES) {
+              lost = true;
+            } else {
+              if(value == I2CSNIFF_ESCAPE) {
+                ringBuffer[tail] = I2CSNIFF_ESCAPE;
+                tail = (tail + 1) & (I2CSNIFF_BUF_SIZE - 1);
+                value = I2CSNIFF_LITERAL;
+              }
+              ringBuffer[tail] = value;
+              tail = (tail + 1) & (I2CSNIFF_BUF_SIZE - 1);
+              if(lines & (1<<SDA_BIT)) {
+                ringBuffer[tail] = I2CSNIFF_ESCAPE;
+                tail = (tail + 1) & (I2CSNIFF_BUF_SIZE - 1);
+                ringBuffer[tail] = I2CSNIFF_NACK;
+                tail = (tail + 1) & (I2CSNIFF_BUF_SIZE - 1);
+              }
+            }
+          }
+        }
+      } else if((lines & (1<<SCL_BIT)) && (previous & (1<<SCL_BIT))) {
+        // SDA changed while SCL is high: falling is a START, rising is a STOP
+        uint8_t event = (lines & (1<<SDA_BIT)) ? I2CSNIFF_STOP : I2CSNIFF_START;
+        inTransfer = (event == I2CSNIFF_START);
+        bitCount = 0;
+
+        if(room < EVENT_MAX_BYTES) {
+          lost = true;
+        } else {
+          if(lost) {
+            // said before the event, so the stream stays in order
+            ringBuffer[tail] = I2CSNIFF_ESCAPE;
+            tail = (tail + 1) & (I2CSNIFF_BUF_SIZE - 1);
+            ringBuffer[tail] = I2CSNIFF_OVERFLOW;
+            tail = (tail + 1) & (I2CSNIFF_BUF_SIZE - 1);
+            lost = false;
+          }
+          ringBuffer[tail] = I2CSNIFF_ESCAPE;
+          tail = (tail + 1) & (I2CSNIFF_BUF_SIZE - 1);
+          ringBuffer[tail] = event;
+          tail = (tail + 1) & (I2CSNIFF_BUF_SIZE - 1);
+        }
+      }
+
+      previous = lines;
+    }
+
+    // drain the ring buffer
+    if(uartBusy && (LINSIR & (1<<LTXOK))) {
+      LINSIR = (1<<LTXOK); // clear the flag
+      uartBusy = false;
+    }
+    if(!uartBusy && head != tail) {
+      LINDAT = ringBuffer[head];
+      head = (head + 1) & (I2CSNIFF_BUF_SIZE - 1);
+      uartBusy = true;
+    }
+  }
+}
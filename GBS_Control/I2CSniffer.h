@@ -0,0 +1,65 @@
+/*
+  Passive I2C sniffer for the Digispark Pro
+
+  Listens to the bus on I2CBitBanger's pins (SDA on PB0, SCL on PB2), left as inputs so
+  nothing is ever driven, e.g. to capture the GBS 8220's onboard microcontroller programming
+  the scaler.  Everything seen on the bus is streamed out of the LIN/UART TX pin
+  (PA1, Digispark Pro pin 7) at I2CSNIFF_BAUD, 8N1.
+
+  run() never returns.  It polls the pins in a tight loop with interrupts off: START, STOP,
+  every byte and its ACK/NACK are decoded as the edges are seen and the results go into a RAM
+  ring buffer that is drained to the UART one byte at a time from the same loop.  A pass of the
+  loop takes about a microsecond (a few more on the pass that decodes an edge, the next edge is
+  always further away), less than the shortest phase of the stock microcontroller's bus
+  (3us of SCL high, see I2CBitBangerTiming.h), so no edge is missed.
+  The UART is faster than the bus, so the ring buffer only smooths out bursts of START/STOP.
+
+  The stream is the bytes on the bus as they are, with these escapes:
+    I2CSNIFF_ESCAPE, I2CSNIFF_START     START (or repeated START), the slave address byte follows
+    I2CSNIFF_ESCAPE, I2CSNIFF_STOP      STOP
+    I2CSNIFF_ESCAPE, I2CSNIFF_NACK      the byte before was NACKed (bytes are ACKed otherwise)
+    I2CSNIFF_ESCAPE, I2CSNIFF_OVERFLOW  the ring buffer was full, something was lost before this
+    I2CSNIFF_ESCAPE, I2CSNIFF_LITERAL   a byte with the value I2CSNIFF_ESCAPE
+
+  sourceSettingsFiles/gbsTableCompiler's capture command turns a captured stream into a .set file.
+
+  Usage:
+
+    I2CSniffer sniffer;
+    sniffer.run();
+*/
+
+#ifndef I2CSniffer_h
+#define I2CSniffer_h
+
+#include <inttypes.h>
+#include <Arduino.h>
+#include "I2CBitBanger.h"   // pin definitions
+
+#ifndef I2CSNIFF_BAUD
+#define I2CSNIFF_BAUD 250000UL   // F_CPU / (8 * I2CSNIFF_BAUD) must be a whole number
+#endif
+
+#define I2CSNIFF_BUF_SIZE 64     // ring buffer bytes (must be a power of 2)
+
+#define I2CSNIFF_ESCAPE   0xFE
+#define I2CSNIFF_LITERAL  0x00
+#define I2CSNIFF_START    0x01
+#define I2CSNIFF_STOP     0x02
+#define I2CSNIFF_NACK     0x03
+#define I2CSNIFF_OVERFLOW 0x04
+
+class I2CSniffer {
+
+public:
+I2CSniffer();
+void run(); // releases the bus pins, sets up the UART and sniffs forever
+
+private:
+void initializeUart();
+
+uint8_t ringBuffer[I2CSNIFF_BUF_SIZE];
+
+};
+
+#endif
@@ -1,10 +1,25 @@
+
 #include "NECIRReceiver.h"
 
 int NECIRReceiver::start_bit = 3000; //Start bit threshold (Microseconds)
+int NECIRReceiver::start_bit_max = 6000; //Longest start bit accepted (Microseconds)
 int NECIRReceiver::repeat_bit = 1700; //Repeat bit threshold (Microseconds)
 int NECIRReceiver::bin_1 = 900; //Binary 1 threshold (Microseconds)
 int NECIRReceiver::bin_0 = 400; //Binary 0 threshold (Microseconds)
 
+unsigned long NECIRReceiver::lastEdgeMicros = 0;
+int8_t NECIRReceiver::bitsReceived = -1;
+uint32_t NECIRReceiver::frameData = 0;
+
+volatile int NECIRReceiver::buttonQueue[NEC_QUEUE_SIZE];
+volatile uint8_t NECIRReceiver::buttonQueueHead = 0;
+volatile uint8_t NECIRReceiver::buttonQueueTail = 0;
+
+
+ISR(NEC_IR_PCINT_vect) {
+  NECIRReceiver::handlePinChange();
+}
+
 
 NECIRReceiver::NECIRReceiver() {}
 
@@ -12,6 +27,13 @@ NECIRReceiver::NECIRReceiver(int irPinArg) {
   irPin = irPinArg;
 }
 
+void NECIRReceiver::begin() {
+  pinMode(irPin, INPUT);
+  
+  NEC_IR_PCMSK |= (1<<NEC_IR_PIN_BIT); // interrupt on changes of the IR pin
+  PCICR |= (1<<NEC_IR_PCIE);
+}
+
 int NECIRReceiver::getIrPin() {
   return irPin;
 }
@@ -23,42 +45,89 @@ void NECIRReceiver::setIrPin(int irPinArg) {
 
 
 int NECIRReceiver::getIRButtonValue() {
-  return getIRButtonValue(irPin);
+  if(buttonQueueHead == buttonQueueTail) {
+    return NEC_NO_INPUT;
+  }
+  
+  int value = buttonQueue[buttonQueueHead];
+  buttonQueueHead = (buttonQueueHead + 1) & (NEC_QUEUE_SIZE - 1);
+  return value;
+}
+
+
+int NECIRReceiver::peekIRButtonValue() {
+  if(buttonQueueHead == buttonQueueTail) {
+    return NEC_NO_INPUT;
+  }
+  
+  return buttonQueue[buttonQueueHead];
+}
+
+
+void NECIRReceiver::pushButtonValue(int value) {
+  uint8_t nextTail = (buttonQueueTail + 1) & (NEC_QUEUE_SIZE - 1);
+  if(nextTail == buttonQueueHead) {
+    return; // queue full, drop the value
+  }
+  
+  buttonQueue[buttonQueueTail] = value;
+  buttonQueueTail = nextTail;
 }
 
 
 // decode infrared signal
-int NECIRReceiver::getIRButtonValue(int irPinArg) {
-  int data[NEC_BIT_PER_BLOCK];
-  int i;
-  int test; 
- 
-  test = pulseIn(irPinArg, HIGH); 
-  if(test > start_bit) //tests for the 4.5 ms start bit
-  {
-    for(i = 0 ; i < NEC_BIT_PER_BLOCK ; i++) 
-      data[i] = pulseIn(irPinArg, HIGH); //Start measuring bits, I only want HIGH pulses
- 
-    delay(100);  
-    for(i = 0 ; i < NEC_BIT_PER_BLOCK ; i++) //Parse them
-    {   
-      if(data[i] > bin_1) //is it a 1?
-        data[i] = 1;
-      else if(data[i] > bin_0) //is it a 0?
-        data[i] = 0;
-      else
-        return -2; //Flag the data as invalid; Return -2 on invalid data
+void NECIRReceiver::handlePinChange() {
+  /*
+    The IR receiver output is HIGH between the (LOW) bursts of the NEC frame,
+    and the length of each HIGH space carries the information:
+      ~4.5ms  start of a frame (followed by 32 bits)
+      ~2.25ms repeat (button held down)
+      ~1.69ms binary 1
+      ~0.56ms binary 0
+    A space has ended when the pin goes LOW, so only falling edges are decoded.
+  */
+  
+  unsigned long now = micros();
+  
+  if(NEC_IR_PIN_REG & (1<<NEC_IR_PIN_BIT)) {
+    // rising edge, the space starts now
+    lastEdgeMicros = now;
+    return;
+  }
+  
+  unsigned long space = now - lastEdgeMicros;
+  
+  if(space > (unsigned long)start_bit) {
+    // only a start bit if it isn't the idle time before a frame
+    bitsReceived = (space < (unsigned long)start_bit_max) ? 0 : -1;
+    frameData = 0;
+    return;
+  }
+  
+  if(bitsReceived < 0) {
+    if(space > (unsigned long)repeat_bit) {
+      pushButtonValue(NEC_REPEAT);
     }
-    
+    return;
+  }
+  
+  if(space > (unsigned long)bin_1) { //is it a 1?
+    frameData |= ((uint32_t)1 << bitsReceived);
+  } else if(space <= (unsigned long)bin_0) { //is it a 0?
+    pushButtonValue(NEC_INVALID); //Flag the data as invalid
+    bitsReceived = -1;
+    return;
+  }
+  
+  bitsReceived++;
+  
+  if(bitsReceived == NEC_BIT_PER_BLOCK) {
     //based on NEC protocol, command data started from bit 16
-    //and end with bit 24 (8 bits long)
-    int result = 0;
-    for(i = 16 ; i < 24; i++) { 
-      if(data[i] == 1) result |= (1<<i-16); //Convert data bits to integer
-    }  
-    return result; //Return key number
- 
+    //and end with bit 24 (8 bits long), followed by its inverse
+    uint8_t command = (uint8_t)(frameData >> 16);
+    uint8_t inverseCommand = (uint8_t)(frameData >> 24);
+    
+    pushButtonValue( ((command ^ inverseCommand) == 0xff) ? (int)command : NEC_INVALID );
+    bitsReceived = -1;
   }
-  else if(test > repeat_bit) return -1; //Tests for the 2.5 ms repeat bit and sends -1 if true
- 
 }
@@ -2,26 +2,52 @@
 
 #define NEC_BIT_PER_BLOCK 32
 
+// Pin change interrupt for the IR receiver pin.
+// These must match the pin passed to the constructor (Digispark Pro pin 11 is PA5, PCINT5)
+#define NEC_IR_PIN_REG   PINA
+#define NEC_IR_PIN_BIT   5
+#define NEC_IR_PCMSK     PCMSK0
+#define NEC_IR_PCIE      PCIE0
+#define NEC_IR_PCINT_vect PCINT0_vect
+
+#define NEC_QUEUE_SIZE 8 // decoded buttons waiting to be read (must be a power of 2)
+
+// getIRButtonValue return values other than a button value
+#define NEC_REPEAT   -1  // the last button is being held down
+#define NEC_INVALID  -2  // a frame was received but could not be decoded
+#define NEC_NO_INPUT -3  // nothing has been received since the last call
+
 class NECIRReceiver {
 
 public:
 NECIRReceiver(int irPinArg);
-int getIRButtonValue();
+void begin(); // enables the pin change interrupt, call from setup()
+int getIRButtonValue(); // never blocks, returns the oldest decoded button (or one of the values above)
+int peekIRButtonValue(); // same as getIRButtonValue, but leaves the value in the queue
 int getIrPin();
 void setIrPin(int irPinArg);
 
+static void handlePinChange(); // called from the pin change interrupt, not for use by sketches
+
 private:
 NECIRReceiver();
-int getIRButtonValue(int irPinArg);
+static void pushButtonValue(int value);
 
 int irPin;
 static int start_bit;
+static int start_bit_max;
 static int repeat_bit;
 static int bin_1;
 static int bin_0;
 
-};
-
-
+// decoder state (only touched by the interrupt)
+static unsigned long lastEdgeMicros;
+static int8_t bitsReceived; // -1 while waiting for a start bit
+static uint32_t frameData;
 
+// decoded buttons, written by the interrupt and read by getIRButtonValue
+static volatile int buttonQueue[NEC_QUEUE_SIZE];
+static volatile uint8_t buttonQueueHead;
+static volatile uint8_t buttonQueueTail;
 
+};
@@ -0,0 +1,30 @@
+// Generated by sourceSettingsFiles/gbsTableCompiler (do not edit by hand)
+// Burst arrays that switch the scaler from one program array to another
+
+const uint8_t presetDelta240pTo480i[] PROGMEM = {
+// count, first register, values...
+1, 240, 0,
+3, 7, 25, 4, 5,
+8, 14, 225, 0, 48, 30, 12, 0, 0, 24,
+1, 27, 15,
+1, 240, 3,
+4, 5, 227, 6, 29, 232,
+1, 22, 41,
+1, 240, 4,
+1, 74, 1,
+0
+};
+
+const uint8_t presetDelta480iTo240p[] PROGMEM = {
+// count, first register, values...
+1, 240, 0,
+3, 7, 27, 4, 37,
+8, 14, 97, 0, 144, 44, 29, 0, 0, 100,
+1, 27, 6,
+1, 240, 3,
+4, 5, 211, 6, 8, 250,
+1, 22, 32,
+1, 240, 4,
+1, 74, 0,
+0
+};
@@ -0,0 +1,83 @@
+#include "PresetStream.h"
+
+PresetStream::PresetStream() {
+  start(&stream, NULL);
+  start(&base, NULL);
+  hasBase = false;
+}
+
+
+void PresetStream::start(Decoder* decoder, const uint8_t* data) {
+  decoder->position = data;
+  decoder->kind = PRESET_TOKEN_ZEROS;
+  decoder->remaining = 0;
+  decoder->value = 0;
+}
+
+
+void PresetStream::begin(const uint8_t* programArray) {
+  uint8_t baseNumber = pgm_read_byte(programArray);
+  
+  start(&stream, programArray + 1);
+  
+  hasBase = (baseNumber != 0);
+  if(hasBase) {
+    const uint8_t* baseArray = (const uint8_t*)pgm_read_word(&presetStreamBases[baseNumber - 1]);
+    start(&base, baseArray + 1);
+  }
+}
+
+
+uint8_t PresetStream::decode(Decoder* decoder, uint8_t baseValue) {
+  if(decoder->remaining == 0) {
+    uint8_t token = pgm_read_byte(decoder->position++);
+    decoder->kind = token & PRESET_TOKEN_KIND;
+    decoder->remaining = (token & PRESET_TOKEN_RUN) + 1;
+    
+    if(decoder->kind == PRESET_TOKEN_REPEAT) {
+      decoder->value = pgm_read_byte(decoder->position++);
+    }
+  }
+  
+  decoder->remaining--;
+  
+  switch(decoder->kind) {
+    case PRESET_TOKEN_LITERAL:
+      return pgm_read_byte(decoder->position++);
+    case PRESET_TOKEN_ZEROS:
+      return 0;
+    case PRESET_TOKEN_REPEAT:
+      return decoder->value;
+    default:
+      return baseValue;
+  }
+}
+
+
+uint8_t PresetStream::next() {
+  // the base is decompressed in step even when its values aren't used
+  uint8_t baseValue = hasBase ? decode(&base, 0) : 0;
+  return decode(&stream, baseValue);
+}
+
+
+void PresetStream::skip(uint16_t numValues) {
+  while(numValues-- > 0) {
+    next();
+  }
+}
+
+
+void PresetStream::seek(const uint8_t* programArray, uint8_t segment, uint8_t firstRegister) {
+  begin(programArray);
+  skip(segment * PRESET_REGISTERS_PER_SEGMENT + firstRegister);
+}
+
+
+void PresetStream::read(const uint8_t* programArray, uint8_t segment, uint8_t firstRegister, uint8_t numValues, uint8_t* output) {
+  seek(programArray, segment, firstRegister);
+  
+  for(uint8_t i = 0; i < numValues; i++) {
+    output[i] = next();
+  }
+}
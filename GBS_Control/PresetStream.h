@@ -0,0 +1,71 @@
+/*
+  Streaming decompressor for the compressed program arrays in CompressedPresets.h
+
+  A program array holds registers 0x00 - 0xEF of each of the 6 scaler segments (1440 values)
+  as a stream of tokens made by sourceSettingsFiles/gbsTableCompiler.  The top 2 bits of a token
+  are its kind and the low 6 bits are the run length - 1:
+  
+    PRESET_TOKEN_LITERAL   the next run length bytes are the values
+    PRESET_TOKEN_ZEROS     run length zeros
+    PRESET_TOKEN_REPEAT    the next byte, run length times
+    PRESET_TOKEN_BASE      the base program array's values at the same positions
+  
+  Byte 0 of a program array is 0, or the position + 1 of its base in presetStreamBases.
+  A base is always a program array without a base of its own, so it is decompressed in step
+  with the program array and nothing but the two read positions is kept in RAM.
+  
+  Decompressing a value takes a few dozen cycles, far less than clocking it out on the bus,
+  so the values can be fed straight to I2CBitBanger as they are sent.
+*/
+
+#ifndef PresetStream_h
+#define PresetStream_h
+
+#include <inttypes.h>
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+#define PRESET_TOKEN_LITERAL 0x00
+#define PRESET_TOKEN_ZEROS   0x40
+#define PRESET_TOKEN_REPEAT  0x80
+#define PRESET_TOKEN_BASE    0xC0
+#define PRESET_TOKEN_KIND    0xC0
+#define PRESET_TOKEN_RUN     0x3F
+
+#define PRESET_NUM_SEGMENTS          6
+#define PRESET_REGISTERS_PER_SEGMENT 240  // registers 0x00 - 0xEF
+
+// defined in CompressedPresets.h (include it after this file)
+extern const uint8_t* const presetStreamBases[] PROGMEM;
+
+class PresetStream {
+
+public:
+PresetStream();
+
+void begin(const uint8_t* programArray); // starts at segment 0 register 0x00
+uint8_t next();                          // the next register value
+void skip(uint16_t numValues);
+void seek(const uint8_t* programArray, uint8_t segment, uint8_t firstRegister); // starts at the given register
+
+// starts at the given register and copies numValues values to output
+void read(const uint8_t* programArray, uint8_t segment, uint8_t firstRegister, uint8_t numValues, uint8_t* output);
+
+private:
+struct Decoder {
+  const uint8_t* position; // next token or value in flash
+  uint8_t kind;            // kind of the current token
+  uint8_t remaining;       // values left in the current token
+  uint8_t value;           // PRESET_TOKEN_REPEAT value
+};
+
+static uint8_t decode(Decoder* decoder, uint8_t baseValue);
+static void start(Decoder* decoder, const uint8_t* data);
+
+Decoder stream;
+Decoder base;
+bool hasBase;
+
+};
+
+#endif
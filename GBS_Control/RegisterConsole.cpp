@@ -0,0 +1,336 @@
+#include "RegisterConsole.h"
+
+#if REGISTER_CONSOLE
+#include <avr/interrupt.h>
+#include <util/crc16.h>
+
+volatile uint8_t RegisterConsole::rxBuffer[CONSOLE_RX_BUFFER_SIZE];
+volatile uint8_t RegisterConsole::rxHead = 0;
+volatile uint8_t RegisterConsole::rxTail = 0;
+volatile bool RegisterConsole::rxOverrun = false;
+
+
+ISR(LIN_TC_vect) {
+  RegisterConsole::handleReceive();
+}
+
+
+static uint8_t blockCrc(const uint8_t* data, uint8_t count) {
+  // the CRC-8 of a run header or a chunk on its own, apart from the frame CRC
+  uint8_t crc = 0;
+  for(uint8_t i = 0; i < count; i++) {
+    crc = _crc8_ccitt_update(crc, data[i]);
+  }
+  return crc;
+}
+
+
+static uint8_t requestPayloadLength(uint8_t command) {
+  // the payload length of each command other than CONSOLE_WRITE
+  switch(command) {
+    case CONSOLE_PING: return 0;
+    case CONSOLE_READ: return CONSOLE_RUN_HEADER;
+    case CONSOLE_STATUS: return 0;
+#if I2CBB_STATS
+    case CONSOLE_I2C_STATS: return 1;
+#endif
+    default: return CONSOLE_UNKNOWN_COMMAND;
+  }
+}
+
+
+RegisterConsole::RegisterConsole() {
+  crc = 0;
+  transmitting = false;
+}
+
+
+void RegisterConsole::begin() {
+  // LIN/UART in UART mode, 8N1, full duplex, interrupt on every received byte
+  LINCR = (1<<LSWRES);
+  LINBTR = (1<<LDISR) | CONSOLE_SAMPLES;
+  LINBRR = ((F_CPU + CONSOLE_SAMPLES * CONSOLE_BAUD / 2) / (CONSOLE_SAMPLES * CONSOLE_BAUD)) - 1;
+  LINENIR = (1<<LENRXOK);
+  LINCR = (1<<LENA) | (1<<LCMD2) | (1<<LCMD1) | (1<<LCMD0);
+}
+
+
+void RegisterConsole::handleReceive() {
+  if(!(LINSIR & (1<<LRXOK))) {
+    return;
+  }
+
+  uint8_t value = LINDAT;  // also clears LRXOK
+  uint8_t nextTail = (rxTail + 1) & (CONSOLE_RX_BUFFER_SIZE - 1);
+  if(nextTail == rxHead) {
+    rxOverrun = true;  // buffer full, drop the byte
+    return;
+  }
+
+  rxBuffer[rxTail] = value;
+  rxTail = nextTail;
+}
+
+
+void RegisterConsole::service() {
+  // skip anything received outside of a request (noise, the rest of a request that timed out)
+  while(rxHead != rxTail) {
+    uint8_t value = rxBuffer[rxHead];
+    rxHead = (rxHead + 1) & (CONSOLE_RX_BUFFER_SIZE - 1);
+
+    if(value == CONSOLE_SYNC) {
+      handleRequest();
+      return;
+    }
+  }
+
+  // nothing is pending, so whatever was dropped is of no concern to the next request
+  rxOverrun = false;
+}
+
+
+void RegisterConsole::handleRequest() {
+  /*
+    Receive the command and the payload length
+    Write: write each run as its values arrive
+    Other commands: receive the (short) payload and check it has the right length
+    Receive the CRC and check it
+    Respond with the status, and the values for a read or the counts for CONSOLE_I2C_STATS and CONSOLE_STATUS
+  */
+  uint8_t header[2];  // command, payload length
+  uint8_t arguments[CONSOLE_RUN_HEADER];
+  uint8_t status = CONSOLE_OK;
+
+  crc = 0;
+  if(!receive(header, sizeof(header))) {
+    status = CONSOLE_ERROR_TIMEOUT;
+  } else if(header[0] == CONSOLE_WRITE) {
+    status = receiveWrite(header[1]);
+  } else {
+    if(header[1] != requestPayloadLength(header[0])) {
+      status = CONSOLE_ERROR_COMMAND;
+    }
+
+    for(uint8_t i = 0; i < header[1] && status != CONSOLE_ERROR_TIMEOUT; i++) {
+      uint8_t value;
+      if(!receive(&value, 1)) {
+        status = CONSOLE_ERROR_TIMEOUT;
+      } else if(i < CONSOLE_RUN_HEADER) {
+        arguments[i] = value;
+      }
+    }
+  }
+
+  if(status != CONSOLE_ERROR_TIMEOUT) {
+    // a CRC over the data and the CRC itself comes out as 0
+    uint8_t receivedCrc;
+    if(!receive(&receivedCrc, 1)) {
+      status = CONSOLE_ERROR_TIMEOUT;
+    } else if(crc != 0) {
+      status = CONSOLE_ERROR_CRC;
+    }
+  }
+
+  if(rxOverrun) {
+    status = CONSOLE_ERROR_OVERRUN;
+  }
+
+  transmitting = false;
+
+  if(status == CONSOLE_OK && header[0] == CONSOLE_READ) {
+    sendRead(arguments[0], arguments[1], arguments[2]);
+  } else if(status == CONSOLE_OK && header[0] == CONSOLE_STATUS) {
+    sendStatus();
+  } else if(status == CONSOLE_OK && header[0] == CONSOLE_PING) {
+    uint8_t version = CONSOLE_VERSION;
+    beginResponse(1);
+    transmit(&version, 1);
+    endResponse(status);
+#if I2CBB_STATS
+  } else if(status == CONSOLE_OK && header[0] == CONSOLE_I2C_STATS) {
+    sendStats(arguments[0]);
+#endif
+  } else {
+    beginResponse(0);
+    endResponse(status);
+  }
+}
+
+
+uint8_t RegisterConsole::receiveWrite(uint8_t length) {
+  // writes the runs of a write request a chunk at a time once it and its run header have passed their CRC,
+  // returns the status so far
+  uint8_t status = CONSOLE_OK;
+  uint8_t run[CONSOLE_RUN_HEADER + 1];  // segment, first register, count, run CRC
+  uint8_t values[CONSOLE_WRITE_CHUNK + 1];  // a chunk and its CRC
+
+  if(length == 0) {
+    return CONSOLE_ERROR_COMMAND;
+  }
+
+  while(length > 0) {
+    if(length < sizeof(run)) {
+      // not enough left for a run, take in the rest and give up
+      return skip(length) ? CONSOLE_ERROR_COMMAND : CONSOLE_ERROR_TIMEOUT;
+    }
+
+    if(!receive(run, sizeof(run))) {
+      return CONSOLE_ERROR_TIMEOUT;
+    }
+    length -= sizeof(run);
+
+    // a CRC over the data and the CRC itself comes out as 0
+    if(blockCrc(run, sizeof(run)) != 0) {
+      // none of the rest can be trusted to line up, take it in without writing it
+      return skip(length) ? CONSOLE_ERROR_CRC : CONSOLE_ERROR_TIMEOUT;
+    }
+
+    uint8_t reg = run[1];
+    uint8_t count = run[2];
+    if(count == 0 || CONSOLE_WRITE_RUN_SIZE(count) - sizeof(run) > length) {
+      return skip(length) ? CONSOLE_ERROR_COMMAND : CONSOLE_ERROR_TIMEOUT;
+    }
+    length -= CONSOLE_WRITE_RUN_SIZE(count) - sizeof(run);
+
+    while(count > 0) {
+      uint8_t chunk = (count < CONSOLE_WRITE_CHUNK) ? count : CONSOLE_WRITE_CHUNK;
+      if(!receive(values, chunk + 1)) {
+        return CONSOLE_ERROR_TIMEOUT;
+      }
+
+      if(status == CONSOLE_OK && blockCrc(values, chunk + 1) != 0) {
+        status = CONSOLE_ERROR_CRC;  // nothing after this is written
+      }
+
+      if(status == CONSOLE_OK && !consoleWriteRegisters(run[0], reg, values, chunk)) {
+        status = CONSOLE_ERROR_BUS;
+      }
+
+      reg += chunk;
+      count -= chunk;
+    }
+  }
+
+  return status;
+}
+
+
+void RegisterConsole::sendRead(uint8_t segment, uint8_t firstRegister, uint8_t numRegisters) {
+  // streams the registers out as they are read, the rest are sent as zeros once the bus fails
+  uint8_t status = CONSOLE_OK;
+  uint8_t values[CONSOLE_CHUNK_SIZE];
+
+  beginResponse(numRegisters);
+
+  while(numRegisters > 0) {
+    uint8_t chunk = (numRegisters < CONSOLE_CHUNK_SIZE) ? numRegisters : CONSOLE_CHUNK_SIZE;
+    if(status != CONSOLE_OK || !consoleReadRegisters(segment, firstRegister, chunk, values)) {
+      status = CONSOLE_ERROR_BUS;
+      memset(values, 0, chunk);
+    }
+
+    transmit(values, chunk);
+    firstRegister += chunk;
+    numRegisters -= chunk;
+  }
+
+  endResponse(status);
+}
+
+
+#if I2CBB_STATS
+void RegisterConsole::sendStats(uint8_t flags) {
+  uint8_t values[CONSOLE_CHUNK_SIZE];
+
+  beginResponse(sizeof(I2CBBStats));
+
+  for(uint8_t offset = 0; offset < sizeof(I2CBBStats); offset += sizeof(values)) {
+    uint8_t chunk = (sizeof(I2CBBStats) - offset < sizeof(values)) ? sizeof(I2CBBStats) - offset : sizeof(values);
+    I2CBitBanger::copyStats(offset, chunk, values);
+    transmit(values, chunk);
+  }
+
+  if(flags & CONSOLE_STATS_CLEAR) {
+    I2CBitBanger::clearStats();
+  }
+
+  endResponse(CONSOLE_OK);
+}
+#endif
+
+
+void RegisterConsole::sendStatus() {
+  ConsoleStatus status;
+  memset(&status, 0, sizeof(status));
+  consoleStatus(&status);
+
+  beginResponse(sizeof(status));
+  transmit((const uint8_t*)&status, sizeof(status));
+  endResponse(CONSOLE_OK);
+}
+
+
+bool RegisterConsole::receive(uint8_t* data, uint8_t count) {
+  // returns false if a byte didn't arrive in time
+  for(uint8_t i = 0; i < count; i++) {
+    unsigned long waitStart = millis();
+    while(rxHead == rxTail) {
+      if(millis() - waitStart > CONSOLE_BYTE_TIMEOUT_MS) {
+        return false;
+      }
+      CONSOLE_WAIT_HOOK();
+    }
+
+    data[i] = rxBuffer[rxHead];
+    rxHead = (rxHead + 1) & (CONSOLE_RX_BUFFER_SIZE - 1);
+    crc = _crc8_ccitt_update(crc, data[i]);
+  }
+
+  return true;
+}
+
+
+bool RegisterConsole::skip(uint8_t count) {
+  // takes in count bytes of the request without keeping them, returns false if they didn't arrive in time
+  uint8_t value;
+  for(uint8_t i = 0; i < count; i++) {
+    if(!receive(&value, 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+void RegisterConsole::transmit(const uint8_t* data, uint8_t count) {
+  for(uint8_t i = 0; i < count; i++) {
+    if(transmitting) {
+      // wait for the byte before to go out
+      while(!(LINSIR & (1<<LTXOK))) {
+        CONSOLE_WAIT_HOOK();
+      }
+    }
+
+    LINSIR = (1<<LTXOK); // clear the flag
+    LINDAT = data[i];
+    transmitting = true;
+    crc = _crc8_ccitt_update(crc, data[i]);
+  }
+}
+
+
+void RegisterConsole::beginResponse(uint8_t length) {
+  uint8_t sync = CONSOLE_SYNC;
+  transmit(&sync, 1);
+  crc = 0;
+  transmit(&length, 1);
+}
+
+
+void RegisterConsole::endResponse(uint8_t status) {
+  transmit(&status, 1);
+  uint8_t responseCrc = crc;
+  transmit(&responseCrc, 1);
+}
+
+#endif
@@ -0,0 +1,102 @@
+/*
+  Binary register console over the LIN/UART for the Digispark Pro
+
+  Lets a host read and write any scaler register (bulk peeks and pokes, segment dumps,
+  uploading a whole preset) without reflashing, through a USB serial adapter on the LIN/UART
+  pins (RX on PA0, Digispark Pro pin 6; TX on PA1, pin 7) at CONSOLE_BAUD, 8N1.
+  The frame format is in RegisterConsoleProtocol.h, hostConsole/gbsConsole.cpp is the host side.
+
+  Received bytes go into a RAM ring buffer from the UART interrupt, so nothing is lost while the
+  sketch is busy elsewhere for up to CONSOLE_RX_BUFFER_SIZE byte times (about 16ms).
+  service() returns straight away unless a request has started to arrive.  It then handles the
+  whole request and its response before returning, waiting for each byte of the request for up
+  to CONSOLE_BYTE_TIMEOUT_MS.  Register values are read CONSOLE_CHUNK_SIZE and written
+  CONSOLE_WRITE_CHUNK at a time as they are sent or received (each written chunk once its CRC
+  has checked out), so a request can cover a whole segment with little RAM.
+  CONSOLE_BAUD is below the rate registers are written at, so a write keeps up with the UART.
+
+  The registers are accessed through two functions the sketch provides (so it can keep its own
+  state, e.g. the register shadow, coherent with them).  Both return false if the bus failed:
+
+    bool consoleReadRegisters(uint8_t segment, uint8_t firstRegister, uint8_t numRegisters, uint8_t* output);
+    bool consoleWriteRegisters(uint8_t segment, uint8_t firstRegister, uint8_t* values, uint8_t numValues);
+
+  A third one fills in the answer to CONSOLE_STATUS (status is all 0 beforehand):
+
+    void consoleStatus(ConsoleStatus* status);
+
+  Usage:
+
+    RegisterConsole console;
+    console.begin();    // in setup()
+    console.service();  // in loop()
+*/
+
+#ifndef RegisterConsole_h
+#define RegisterConsole_h
+
+#include <inttypes.h>
+#include <Arduino.h>
+#include "I2CBitBanger.h"   // I2CBB_BUF_SIZE, I2CBBStats
+#include "RegisterConsoleProtocol.h"
+
+// The console is a debugging aid, set to 1 to build it into the sketch (the receive buffer alone takes
+// CONSOLE_RX_BUFFER_SIZE bytes of RAM).  Nothing of it is compiled in otherwise.
+#ifndef REGISTER_CONSOLE
+#define REGISTER_CONSOLE 0
+#endif
+
+#define CONSOLE_SAMPLES          16   // UART samples per bit
+#define CONSOLE_RX_BUFFER_SIZE   64   // must be a power of 2
+#define CONSOLE_BYTE_TIMEOUT_MS  20
+#define CONSOLE_CHUNK_SIZE       (I2CBB_BUF_SIZE - 1)  // register values per I2C transfer
+#define CONSOLE_UNKNOWN_COMMAND  0xFF                  // requestPayloadLength of a command this build doesn't have
+
+#if CONSOLE_WRITE_CHUNK > CONSOLE_CHUNK_SIZE
+#error "a chunk of a console write has to fit in one I2C transfer"
+#endif
+
+// Called while waiting for the UART, lets a host simulation run its clock (nothing on the AVR)
+#ifndef CONSOLE_WAIT_HOOK
+#define CONSOLE_WAIT_HOOK()
+#endif
+
+// provided by GBS_Control.ino
+bool consoleReadRegisters(uint8_t segment, uint8_t firstRegister, uint8_t numRegisters, uint8_t* output);
+bool consoleWriteRegisters(uint8_t segment, uint8_t firstRegister, uint8_t* values, uint8_t numValues);
+void consoleStatus(ConsoleStatus* status);
+
+class RegisterConsole {
+
+public:
+RegisterConsole();
+void begin(); // sets up the UART, call from setup()
+void service(); // handles a request if one has arrived, call from loop()
+
+static void handleReceive(); // called from the UART interrupt, not for use by sketches
+
+private:
+void handleRequest();
+uint8_t receiveWrite(uint8_t length);
+void sendRead(uint8_t segment, uint8_t firstRegister, uint8_t numRegisters);
+#if I2CBB_STATS
+void sendStats(uint8_t flags);
+#endif
+void sendStatus();
+bool receive(uint8_t* data, uint8_t count);
+bool skip(uint8_t count);
+void transmit(const uint8_t* data, uint8_t count);
+void beginResponse(uint8_t length);
+void endResponse(uint8_t status);
+
+uint8_t crc;
+bool transmitting;   // a byte has been handed to the UART since the last response started
+
+static volatile uint8_t rxBuffer[CONSOLE_RX_BUFFER_SIZE];
+static volatile uint8_t rxHead;
+static volatile uint8_t rxTail;
+static volatile bool rxOverrun;   // the buffer was full and a byte was dropped
+
+};
+
+#endif
@@ -0,0 +1,92 @@
+/*
+  Frame format of the register console (see RegisterConsole.h), shared with the host tool
+  in hostConsole/gbsConsole.cpp
+
+  Request (host to sketch):
+    CONSOLE_SYNC, command, payload length, payload..., CRC
+  Response (sketch to host):
+    CONSOLE_SYNC, payload length, payload..., status, CRC
+
+  The CRC is a CRC-8 (polynomial 0x07, initial value 0, avr-libc's _crc8_ccitt_update) of every
+  byte after CONSOLE_SYNC.  The status comes after the payload so a read can be streamed out as
+  it comes off the bus; if the bus fails part way, the rest of the payload is sent as zeros and
+  the status says so.
+
+  Commands and their payloads:
+    CONSOLE_PING       request: nothing
+                       response: CONSOLE_VERSION
+    CONSOLE_READ       request: segment, first register, count (1-255)
+                       response: the count register values
+    CONSOLE_WRITE      request: one or more runs of segment, first register, count (1-243), run CRC,
+                                then the values in chunks of CONSOLE_WRITE_CHUNK (the last one may be shorter),
+                                each followed by its chunk CRC (CONSOLE_WRITE_RUN_SIZE(count) bytes a run)
+                       response: nothing
+    CONSOLE_I2C_STATS  request: CONSOLE_STATS_CLEAR to clear the counts once they have been sent, or 0
+                       response: I2CBitBanger's I2CBBStats (see I2CBitBanger.h), little endian without padding
+                       (CONSOLE_ERROR_COMMAND if the sketch was built without I2CBB_STATS)
+    CONSOLE_STATUS     request: nothing
+                       response: ConsoleStatus (below), the sketch's diagnostics
+
+  The run and chunk CRCs are CRC-8s of the run header and of the chunk's values only.  A write is
+  done a chunk at a time as the values arrive, so a whole segment (240 registers) is written in one
+  round trip, but only once its run header and the chunk have passed their CRC: a corrupted byte
+  stops the request before anything it affects is written.  A write that is answered with
+  CONSOLE_ERROR_CRC (or an error that ends it part way) may have written the chunks before that
+  and is simply sent again.
+*/
+
+#ifndef RegisterConsoleProtocol_h
+#define RegisterConsoleProtocol_h
+
+#include <stdint.h>
+
+#define CONSOLE_BAUD          38400UL
+#define CONSOLE_SYNC          0xA5
+#define CONSOLE_VERSION       2     // 2: run and chunk CRCs in CONSOLE_WRITE
+#define CONSOLE_MAX_PAYLOAD   255
+#define CONSOLE_RUN_HEADER    3     // segment, first register, count
+#define CONSOLE_WRITE_CHUNK   32    // values per chunk CRC of a write
+
+// bytes of a write run of count values, header and CRCs included
+#define CONSOLE_WRITE_RUN_SIZE(count) \
+  (CONSOLE_RUN_HEADER + 1 + (count) + ((count) + CONSOLE_WRITE_CHUNK - 1) / CONSOLE_WRITE_CHUNK)
+
+// commands
+#define CONSOLE_PING          0x01
+#define CONSOLE_READ          0x02
+#define CONSOLE_WRITE         0x03
+#define CONSOLE_I2C_STATS     0x04
+#define CONSOLE_STATUS        0x05
+
+// CONSOLE_I2C_STATS flags
+#define CONSOLE_STATS_CLEAR   0x01
+
+// ConsoleStatus built bits
+#define CONSOLE_BUILT_SHADOW_VERIFY   0x01
+#define CONSOLE_BUILT_FORMAT_DETECT   0x02
+#define CONSOLE_BUILT_PROGRAM_VERIFY  0x04
+
+// CONSOLE_STATUS response, little endian without padding.  The counts of a part the sketch was built without
+// (see built) are 0.  Times in us wrap around after about 71 minutes.
+struct __attribute__((packed)) ConsoleStatus {
+  uint8_t  built;                  // CONSOLE_BUILT_... bits
+  uint32_t bootWaitUs[2];          // how long boot waited for the scaler to ACK before the start and the program array
+  uint8_t  bootWaitTimeouts;       // waits that gave up
+  uint16_t shadowMismatches;       // shadowed reads the scaler disagreed with (SHADOW_VERIFY)
+  uint32_t formatPollUs;           // how long the last input format poll took
+  uint32_t formatDetectedMs;       // millis() when the current format was detected
+  uint32_t formatSwitchUs;         // how long switching to its preset took
+  uint32_t verifyPassUs;           // how long the last complete readback verification took
+  uint16_t verifyBanksRewritten;   // banks it had to rewrite
+  uint16_t verifyFailures;         // banks (and segment CRCs) that still differed after that
+};
+
+// status
+#define CONSOLE_OK            0x00
+#define CONSOLE_ERROR_CRC     0x01  // the request was corrupted
+#define CONSOLE_ERROR_COMMAND 0x02  // unknown command or a malformed payload
+#define CONSOLE_ERROR_BUS     0x03  // an I2C transfer failed
+#define CONSOLE_ERROR_TIMEOUT 0x04  // the request stopped part way
+#define CONSOLE_ERROR_OVERRUN 0x05  // bytes of the request were lost (the sketch was busy for too long)
+
+#endif
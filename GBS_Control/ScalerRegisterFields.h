@@ -0,0 +1,216 @@
+/*
+  Typed access to the scaler's register fields
+
+  Many scaler settings are wider than a register, and several of them share a register
+  (e.g. HBST uses bits 0-3 of 0x05, HBSP bits 4-7).  scalerFields[] describes where each
+  field lives: the segment, the register holding its lowest bit, the bit within that
+  register and the width in bits.  A field continues into the following register(s),
+  low bits first, the same way the scaler stores them.
+
+  ScalerRegisterFields<field, field, ...> works on the registers covering a set of fields
+  of one segment.  The layout is resolved at compile time, so get()/set() compile down to
+  the shifts and masks that were written out by hand before.
+
+    ScalerRegisterFields<HRST, HBST, HBSP> fields;  // registers 0x01 - 0x06 of segment 3
+    if(fields.read()) {                            // one read for all of them
+      fields.set<HBST>(fields.get<HBST>() + 4);
+      fields.set<HBSP>(fields.get<HBSP>() + 4);
+      fields.write();                              // 0x04 - 0x06 in one burst, 0x05 holds both
+    }
+
+  The STATUS_ fields are measurements of the input the scaler makes itself (segment 0), they are
+  only read.
+
+  set() only changes the bits of the field, the other bits of a shared register keep the value
+  they were read with.  write() only queues the registers that changed, from the first to the last
+  of them (a register in between that didn't change is rewritten with the value it was read with,
+  which is cheaper than a second transaction).  Nothing is queued if no register changed.
+
+  read() and write() use readFromRegister() and queueRegisterWrites() of GBS_Control.ino, so the
+  register shadow, segment select elision and write combining apply to them as well.
+*/
+
+#ifndef ScalerRegisterFields_h
+#define ScalerRegisterFields_h
+
+#include <inttypes.h>
+#include <string.h>
+
+struct ScalerField {
+  uint8_t segment;
+  uint8_t firstRegister;  // register holding bit 0 of the field
+  uint8_t bitOffset;      // position of bit 0 of the field in firstRegister
+  uint8_t width;          // in bits (bitOffset + width must not be more than 16)
+};
+
+enum ScalerFieldId {
+  HRST,    // horizontal total
+  HBST,    // horizontal blanking start
+  HBSP,    // horizontal blanking stop
+  HSCALE,  // horizontal scaling
+  VRST,    // vertical total
+  VBST,    // vertical blanking start
+  VBSP,    // vertical blanking stop
+  STATUS_SP_HSACT,   // sync processor status (read only): hsync active
+  STATUS_SP_VSACT,   // vsync active
+  STATUS_SP_VTOTAL,  // lines per field of the input
+  NUM_SCALER_FIELDS
+};
+
+constexpr ScalerField scalerFields[NUM_SCALER_FIELDS] = {
+  // segment, register, bit, width
+  { 0x03, 0x01, 0, 11 },  // HRST
+  { 0x03, 0x04, 0, 12 },  // HBST
+  { 0x03, 0x05, 4, 12 },  // HBSP
+  { 0x03, 0x16, 0, 10 },  // HSCALE
+  { 0x03, 0x02, 4, 11 },  // VRST
+  { 0x03, 0x07, 0, 11 },  // VBST
+  { 0x03, 0x08, 4, 11 },  // VBSP
+  { 0x00, 0x16, 1, 1 },   // STATUS_SP_HSACT  (TV5725 status 0x16: bit 1 HSACT, bit 3 VSACT, 0x0a with both)
+  { 0x00, 0x16, 3, 1 },   // STATUS_SP_VSACT
+  { 0x00, 0x1B, 0, 11 },  // STATUS_SP_VTOTAL
+};
+
+// provided by GBS_Control.ino
+bool queueRegisterWrites(uint8_t segment, uint8_t firstRegister, const uint8_t* values, uint8_t numValues);
+int readFromRegister(uint8_t segment, uint8_t reg, int bytesToRead, uint8_t* output);
+
+
+// compile time helpers for ScalerRegisterFields
+namespace scalerFieldLayout {
+
+constexpr uint8_t lastRegister(uint8_t field) {
+  return scalerFields[field].firstRegister + (scalerFields[field].bitOffset + scalerFields[field].width - 1) / 8;
+}
+
+constexpr uint8_t firstOf(uint8_t field) {
+  return scalerFields[field].firstRegister;
+}
+
+template<typename... Rest>
+constexpr uint8_t firstOf(uint8_t field, Rest... rest) {
+  return firstOf(field) < firstOf(rest...) ? firstOf(field) : firstOf(rest...);
+}
+
+constexpr uint8_t lastOf(uint8_t field) {
+  return lastRegister(field);
+}
+
+template<typename... Rest>
+constexpr uint8_t lastOf(uint8_t field, Rest... rest) {
+  return lastOf(field) > lastOf(rest...) ? lastOf(field) : lastOf(rest...);
+}
+
+constexpr bool sameSegment(uint8_t) {
+  return true;
+}
+
+constexpr bool sameSegment(uint8_t segment, uint8_t field) {
+  return scalerFields[field].segment == segment;
+}
+
+template<typename... Rest>
+constexpr bool sameSegment(uint8_t segment, uint8_t field, Rest... rest) {
+  return sameSegment(segment, field) && sameSegment(segment, rest...);
+}
+
+constexpr bool fitsInTwoRegisters(uint8_t field) {
+  return field < NUM_SCALER_FIELDS && scalerFields[field].bitOffset + scalerFields[field].width <= 16;
+}
+
+template<typename... Rest>
+constexpr bool fitsInTwoRegisters(uint8_t field, Rest... rest) {
+  return fitsInTwoRegisters(field) && fitsInTwoRegisters(rest...);
+}
+
+}
+
+
+template<uint8_t First, uint8_t... Fields>
+class ScalerRegisterFields {
+
+public:
+static constexpr uint8_t segment = scalerFields[First].segment;
+static constexpr uint8_t firstRegister = scalerFieldLayout::firstOf(First, Fields...);
+static constexpr uint8_t numRegisters = scalerFieldLayout::lastOf(First, Fields...) - firstRegister + 1;
+
+static_assert(scalerFieldLayout::fitsInTwoRegisters(First, Fields...), "unknown field or field spans more than two registers");
+static_assert(scalerFieldLayout::sameSegment(scalerFields[First].segment, Fields...), "fields must be in the same segment");
+static_assert(numRegisters <= 16, "fields are too far apart to be read and written together");
+
+bool read() {
+  if(readFromRegister(segment, firstRegister, numRegisters, registers) != numRegisters) {
+    return false;
+  }
+  memcpy(registersRead, registers, numRegisters);
+  return true;
+}
+
+template<uint8_t Field>
+uint16_t get() const {
+  static_assert(includes(Field), "field was not read");
+  const uint8_t index = scalerFields[Field].firstRegister - firstRegister;
+  uint16_t value = registers[index];
+  if(scalerFields[Field].bitOffset + scalerFields[Field].width > 8) {
+    value |= (uint16_t)registers[index + 1] << 8;
+  }
+  return (value >> scalerFields[Field].bitOffset) & mask(Field);
+}
+
+template<uint8_t Field>
+void set(uint16_t value) {
+  static_assert(includes(Field), "field was not read");
+  const uint8_t index = scalerFields[Field].firstRegister - firstRegister;
+  const uint16_t fieldMask = mask(Field) << scalerFields[Field].bitOffset;
+  const uint16_t bits = (value << scalerFields[Field].bitOffset) & fieldMask;
+  registers[index] = (registers[index] & ~(uint8_t)fieldMask) | (uint8_t)bits;
+  if(scalerFields[Field].bitOffset + scalerFields[Field].width > 8) {
+    registers[index + 1] = (registers[index + 1] & ~(uint8_t)(fieldMask >> 8)) | (uint8_t)(bits >> 8);
+  }
+}
+
+bool write() {
+  // the changed registers, and whatever lies between them, as one run
+  uint8_t first = 0;
+  uint8_t last = numRegisters;
+  while(first < last && registers[first] == registersRead[first]) {
+    first++;
+  }
+  while(last > first && registers[last - 1] == registersRead[last - 1]) {
+    last--;
+  }
+  if(first == last) {
+    return true;
+  }
+
+  if(!queueRegisterWrites(segment, firstRegister + first, registers + first, last - first)) {
+    return false;
+  }
+  memcpy(registersRead + first, registers + first, last - first);
+  return true;
+}
+
+private:
+static constexpr uint16_t mask(uint8_t field) {
+  return (uint16_t)((1UL << scalerFields[field].width) - 1);
+}
+
+static constexpr bool includes(uint8_t field) {
+  return field == First || includesAny(field, Fields...);
+}
+
+static constexpr bool includesAny(uint8_t) {
+  return false;
+}
+
+template<typename... Rest>
+static constexpr bool includesAny(uint8_t field, uint8_t other, Rest... rest) {
+  return field == other || includesAny(field, rest...);
+}
+
+uint8_t registers[numRegisters];      // as modified by set()
+uint8_t registersRead[numRegisters];  // as read from (or last written to) the scaler
+
+};
+
+#endif
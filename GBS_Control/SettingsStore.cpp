@@ -0,0 +1,187 @@
+
+#include "SettingsStore.h"
+#include <EEPROM.h>
+#include <util/crc16.h>
+
+static void eepromUpdate(int address, uint8_t value) {
+  // only write (and wear) the cell if its value changes
+  if(EEPROM.read(address) != value) {
+    EEPROM.write(address, value);
+  }
+}
+
+static uint8_t recordCrc(const uint8_t* record, uint8_t length) {
+  uint8_t crc = 0;
+  for(uint8_t i = 0; i < SETTINGS_HEADER_SIZE + length; i++) {
+    crc = _crc8_ccitt_update(crc, record[i]);
+  }
+  return crc;
+}
+
+static bool isNewer(uint16_t sequence, uint16_t thanSequence) {
+  // sequence numbers wrap, so compare them with serial number arithmetic (save keeps them within half the range)
+  return (int16_t)(sequence - thanSequence) > 0;
+}
+
+
+SettingsStore::SettingsStore() {
+  for(uint8_t i = 0; i < SETTINGS_NUM_BANKS; i++) {
+    bankSlot[i] = SETTINGS_NO_SLOT;
+  }
+  nextSlot = 0;
+  lastSequence = 0;
+}
+
+
+bool SettingsStore::begin() {
+  bool foundRecord = false;
+  uint16_t bankSequence[SETTINGS_NUM_BANKS];
+  
+  for(uint8_t slot = 0; slot < SETTINGS_NUM_SLOTS; slot++) {
+    uint8_t bankNumber;
+    uint16_t sequence;
+    uint8_t data[SETTINGS_DATA_SIZE];
+    uint8_t length;
+    
+    if(!readRecord(slot, &bankNumber, &sequence, data, &length)) {
+      continue;
+    }
+    
+    if(bankSlot[bankNumber] == SETTINGS_NO_SLOT || isNewer(sequence, bankSequence[bankNumber])) {
+      bankSlot[bankNumber] = slot;
+      bankSequence[bankNumber] = sequence;
+    }
+    
+    if(!foundRecord || isNewer(sequence, lastSequence)) {
+      lastSequence = sequence;
+      nextSlot = (slot + 1) % SETTINGS_NUM_SLOTS;
+      foundRecord = true;
+    }
+  }
+  
+  return foundRecord;
+}
+
+
+bool SettingsStore::save(uint8_t bankNumber, const uint8_t* data, uint8_t length) {
+  if(bankNumber >= SETTINGS_NUM_BANKS || length > SETTINGS_DATA_SIZE) {
+    return false;
+  }
+  
+  // nothing to do if the bank already holds this data
+  uint8_t existing[SETTINGS_DATA_SIZE];
+  uint8_t existingLength;
+  if(load(bankNumber, existing, &existingLength) && existingLength == length && memcmp(existing, data, length) == 0) {
+    return true;
+  }
+  
+  if(!append(bankNumber, data, length)) {
+    return false;
+  }
+  
+  // keep every bank's current record close enough to the newest one for isNewer (a failed refresh is tried again next time)
+  for(uint8_t bank = 0; bank < SETTINGS_NUM_BANKS; bank++) {
+    uint8_t recordBank;
+    uint16_t sequence;
+    if(bankSlot[bank] != SETTINGS_NO_SLOT && readRecord(bankSlot[bank], &recordBank, &sequence, existing, &existingLength) &&
+       (uint16_t)(lastSequence - sequence) >= SETTINGS_SEQUENCE_REFRESH) {
+      append(bank, existing, existingLength);
+    }
+  }
+  
+  return true;
+}
+
+
+bool SettingsStore::append(uint8_t bankNumber, const uint8_t* data, uint8_t length) {
+  // writes a new record for the bank after the newest one
+  
+  // never overwrite the current record of a bank (including this one, in case the save is interrupted)
+  uint8_t slot = nextSlot;
+  while(isCurrentRecord(slot)) {
+    slot = (slot + 1) % SETTINGS_NUM_SLOTS;
+  }
+  
+  if(!writeRecord(slot, bankNumber, lastSequence + 1, data, length)) {
+    return false;
+  }
+  
+  bankSlot[bankNumber] = slot;
+  nextSlot = (slot + 1) % SETTINGS_NUM_SLOTS;
+  lastSequence++;
+  
+  return true;
+}
+
+
+bool SettingsStore::load(uint8_t bankNumber, uint8_t* data, uint8_t* length) {
+  if(bankNumber >= SETTINGS_NUM_BANKS || bankSlot[bankNumber] == SETTINGS_NO_SLOT) {
+    return false;
+  }
+  
+  uint8_t recordBank;
+  uint16_t sequence;
+  return readRecord(bankSlot[bankNumber], &recordBank, &sequence, data, length) && recordBank == bankNumber;
+}
+
+
+bool SettingsStore::readRecord(uint8_t slot, uint8_t* bankNumber, uint16_t* sequence, uint8_t* data, uint8_t* length) {
+  uint8_t record[SETTINGS_RECORD_SIZE];
+  int address = slot * SETTINGS_RECORD_SIZE;
+  
+  for(uint8_t i = 0; i < SETTINGS_RECORD_SIZE; i++) {
+    record[i] = EEPROM.read(address + i);
+  }
+  
+  if(record[0] != SETTINGS_RECORD_MARKER || record[1] >= SETTINGS_NUM_BANKS || record[4] > SETTINGS_DATA_SIZE ||
+     record[SETTINGS_RECORD_SIZE - 1] != recordCrc(record, record[4])) {
+    return false;
+  }
+  
+  *bankNumber = record[1];
+  *sequence = record[2] | ((uint16_t)record[3] << 8);
+  *length = record[4];
+  memcpy(data, record + SETTINGS_HEADER_SIZE, record[4]);
+  
+  return true;
+}
+
+
+bool SettingsStore::writeRecord(uint8_t slot, uint8_t bankNumber, uint16_t sequence, const uint8_t* data, uint8_t length) {
+  uint8_t record[SETTINGS_RECORD_SIZE];
+  int address = slot * SETTINGS_RECORD_SIZE;
+  
+  record[0] = SETTINGS_RECORD_MARKER;
+  record[1] = bankNumber;
+  record[2] = (uint8_t)(sequence & 0x00ff);
+  record[3] = (uint8_t)(sequence >> 8);
+  record[4] = length;
+  memcpy(record + SETTINGS_HEADER_SIZE, data, length);
+  
+  record[SETTINGS_RECORD_SIZE - 1] = recordCrc(record, length);
+  
+  // unused data bytes are left as they are
+  for(uint8_t i = 0; i < SETTINGS_HEADER_SIZE + length; i++) {
+    eepromUpdate(address + i, record[i]);
+  }
+  eepromUpdate(address + SETTINGS_RECORD_SIZE - 1, record[SETTINGS_RECORD_SIZE - 1]);
+  
+  // make sure it made it (compared with record rather than read back with readRecord, to keep the stack small)
+  for(uint8_t i = 0; i < SETTINGS_HEADER_SIZE + length; i++) {
+    if(EEPROM.read(address + i) != record[i]) {
+      return false;
+    }
+  }
+  return EEPROM.read(address + SETTINGS_RECORD_SIZE - 1) == record[SETTINGS_RECORD_SIZE - 1];
+}
+
+
+bool SettingsStore::isCurrentRecord(uint8_t slot) {
+  for(uint8_t i = 0; i < SETTINGS_NUM_BANKS; i++) {
+    if(bankSlot[i] == slot) {
+      return true;
+    }
+  }
+  return false;
+}
+
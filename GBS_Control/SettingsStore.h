@@ -0,0 +1,75 @@
+/*
+  Wear levelled settings storage for the onboard EEPROM
+
+  Settings are kept in an append-only journal of records spread over the whole EEPROM.
+  Saving a bank writes a new record after the newest one (skipping any slot that holds
+  the current record of a bank), so every slot is written in turn instead of the same
+  few cells every time.  Bytes that already hold the right value are not rewritten, 
+  and saving a bank that hasn't changed writes nothing at all.
+
+  Each record is protected by a CRC, so a record that was only partly written 
+  (e.g. power was lost during a save) is ignored and the previous one is used.
+
+  The EEPROM takes about 3.4ms to write a byte and a new record lands in a different slot,
+  so a save writes most of the header, the data and the CRC: 6 + length bytes, e.g.
+  8 (about 27ms) for 2 bytes of data and 24 (about 80ms) for a full record.
+  
+  begin() scans the journal once and builds an index of the newest record of each bank,
+  after that loading a bank reads a single record.
+
+  Records are ordered by a 16 bit sequence number that wraps around, compared with serial number
+  arithmetic.  That only gives a consistent order while every record is less than half the range
+  behind the newest one.  Old records of a bank are overwritten within one pass over the journal,
+  but the current record of a bank that isn't saved again stays, so a save also writes the current
+  record of any bank SETTINGS_SEQUENCE_REFRESH or more behind out again with a new sequence number
+  (once every 16384 saves at most, for each bank).
+  
+  One record (slot) consists of the following:
+    byte     value
+    0        SETTINGS_RECORD_MARKER
+    1        bank number
+    2        sequence number low
+    3        sequence number high
+    4        length of the bank data (up to SETTINGS_DATA_SIZE)
+    5-22     bank data (only the first length bytes are used)
+    23       CRC-8 of bytes 0-4 and the bank data
+*/
+
+#ifndef SettingsStore_h
+#define SettingsStore_h
+
+#include <inttypes.h>
+#include <Arduino.h>
+
+#define SETTINGS_EEPROM_SIZE   512  // ATtiny167
+#define SETTINGS_NUM_BANKS     10   // banks 0-9
+#define SETTINGS_DATA_SIZE     18
+#define SETTINGS_HEADER_SIZE   5
+#define SETTINGS_RECORD_SIZE   (SETTINGS_HEADER_SIZE + SETTINGS_DATA_SIZE + 1)
+#define SETTINGS_NUM_SLOTS     (SETTINGS_EEPROM_SIZE / SETTINGS_RECORD_SIZE)
+#define SETTINGS_RECORD_MARKER 0x7e
+#define SETTINGS_NO_SLOT       0xff
+#define SETTINGS_SEQUENCE_REFRESH 0x4000  // well under half the sequence range (see above)
+
+class SettingsStore {
+
+public:
+SettingsStore();
+
+bool begin(); // rebuilds the index from the journal, call from setup().  returns false if the journal is empty
+bool save(uint8_t bankNumber, const uint8_t* data, uint8_t length); // returns true if the bank holds data once done
+bool load(uint8_t bankNumber, uint8_t* data, uint8_t* length); // data must hold SETTINGS_DATA_SIZE bytes.  returns false if nothing has been saved to the bank
+
+private:
+bool append(uint8_t bankNumber, const uint8_t* data, uint8_t length);
+bool readRecord(uint8_t slot, uint8_t* bankNumber, uint16_t* sequence, uint8_t* data, uint8_t* length);
+bool writeRecord(uint8_t slot, uint8_t bankNumber, uint16_t sequence, const uint8_t* data, uint8_t length);
+bool isCurrentRecord(uint8_t slot);
+
+uint8_t bankSlot[SETTINGS_NUM_BANKS]; // slot of the newest record of each bank (SETTINGS_NO_SLOT if none)
+uint8_t nextSlot;                     // where the next record goes
+uint16_t lastSequence;                // sequence number of the newest record
+
+};
+
+#endif
@@ -0,0 +1,38 @@
+// Generated by sourceSettingsFiles/gbsTableCompiler from StartArray.h (do not edit by hand)
+// 306 register writes grouped into 31 burst writes
+
+const uint8_t startArrayBursts[] PROGMEM = {
+// count, first register, values...
+1, 240, 0,
+2, 68, 0, 0,
+2, 68, 0, 0,
+1, 240, 5,
+1, 0, 216,
+11, 2, 87, 241, 0, 0, 63, 63, 63, 127, 127, 255, 0,
+2, 14, 0, 0,
+9, 17, 16, 179, 198, 0, 0, 32, 206, 5, 2,
+10, 30, 128, 4, 208, 32, 15, 0, 64, 0, 5, 0,
+1, 42, 15,
+3, 45, 4, 0, 4,
+11, 49, 47, 0, 40, 3, 21, 0, 4, 8, 20, 10, 0,
+31, 62, 192, 3, 11, 52, 0, 70, 0, 0, 192, 5, 192, 4, 192, 52, 192, 103, 192, 103, 192, 0, 192, 5, 192, 192, 33, 192, 5, 192, 1, 200, 6,
+1, 99, 15,
+1, 240, 0,
+2, 64, 124, 69,
+9, 67, 0, 1, 0, 95, 7, 63, 0, 0, 0,
+4, 77, 42, 0, 0, 0,
+3, 82, 0, 0, 0,
+3, 87, 0, 0, 0,
+1, 240, 1,
+43, 0, 96, 224, 100, 255, 255, 255, 255, 255, 255, 255, 255, 79, 134, 5, 89, 203, 18, 0, 71, 0, 44, 3, 92, 0, 87, 3, 135, 0, 4, 2, 8, 0, 24, 0, 114, 3, 123, 6, 127, 6, 4, 0, 0,
+2, 133, 12, 202,
+38, 48, 202, 0, 128, 0, 63, 0, 128, 44, 204, 0, 0, 0, 0, 1, 192, 0, 0, 1, 192, 0, 0, 1, 192, 0, 0, 1, 192, 0, 0, 1, 192, 0, 0, 1, 192, 0, 0, 0,
+36, 96, 208, 34, 32, 39, 65, 62, 178, 154, 78, 214, 177, 142, 124, 99, 139, 118, 112, 98, 133, 105, 83, 72, 93, 148, 178, 70, 198, 238, 140, 98, 118, 156, 0, 0, 53, 0,
+1, 240, 2,
+28, 0, 2, 3, 204, 0, 0, 0, 5, 5, 7, 0, 76, 4, 204, 152, 255, 73, 33, 136, 142, 0, 0, 0, 124, 35, 214, 208, 0, 16,
+6, 31, 16, 81, 2, 4, 15, 0,
+23, 38, 76, 12, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 52, 0, 136, 71, 3, 11, 4, 100, 11, 4, 143,
+1, 240, 4,
+19, 0, 16, 48, 0, 0, 48, 17, 66, 48, 1, 148, 17, 127, 0, 116, 0, 6, 0, 146, 1,
+0
+};
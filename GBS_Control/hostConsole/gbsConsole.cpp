@@ -0,0 +1,646 @@
+/*
+  Host side tool for the register console of GBS_Control (see ../RegisterConsole.h)
+
+  Reads and writes scaler registers through a USB serial adapter on the Digispark Pro's
+  LIN/UART pins, or through anything else that speaks the console protocol on its stdin and
+  stdout (e.g. the host simulator, ../hostSimulator/gbsSimulator.cpp, with -c).
+
+  Build (on the host, not the Digispark):
+    g++ -O2 -o gbsConsole gbsConsole.cpp
+
+  Usage:
+    gbsConsole <port> <command> [<arguments>]
+
+      <port> is a serial device (e.g. /dev/ttyUSB0), set to 38400 baud 8N1, or
+      exec:<command line> to start a stand-in for the board and talk to it through pipes,
+      e.g. "exec:../gbsSimulator -c".
+
+    Commands (numbers are decimal, or hex with a leading 0x):
+
+      ping                                     check the sketch answers, print the protocol version
+      peek <segment> <register> [<count>]      print count (default 1) registers
+      poke <segment> <register> <value> [...]  write the values to consecutive registers
+      dump [<segment>]                         print all 256 registers of the segment (of every segment if none is given)
+      save <set file>                          write all 256 registers of every segment to a .set file, e.g. of a board
+                                               that has just been powered up (built with BOOT_CAPTURE_POWER_UP) for
+                                               gbsTableCompiler's boot command
+      upload <set file or program array>       write registers 0x00 - 0xEF of every segment, one request per
+                                               segment, then read them back and report any that differ
+                                               (except segment 0's read only status registers 0x00 - 0x2F)
+      stats [-c]                               print the I2C counts of each part of the sketch and the histogram of
+                                               transaction times (the sketch has to be built with I2CBB_STATS set
+                                               to 1), -c clears them afterwards
+      status                                   print the sketch's diagnostics: boot waits, input format detection
+                                               and readback verification times and counts
+
+  The input of upload is either a C header (the values between the first '{' and the last '}' are
+  used, comments are ignored) or a .set file (one number per line), 6 segments of 256 registers.
+  A request that was corrupted, timed out or wasn't answered is sent again (up to MAX_ATTEMPTS times).
+*/
+
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "../RegisterConsoleProtocol.h"
+
+#define NUM_SEGMENTS 6
+#define SEGMENT_SIZE 256
+#define PROGRAMMED_REGISTERS_PER_SEGMENT 240
+#define VERIFY_STATUS_REGISTERS 0x30  // segment 0 registers 0x00 - 0x2F can't be read back
+#define MAX_ATTEMPTS 3
+#define RESPONSE_TIMEOUT_MS 1000      // for each byte of a response
+#define NO_RESPONSE 0xFF              // sendRequest's status when nothing (valid) came back
+
+// must match I2CBitBanger.h and the I2C_CALLER_ numbers in GBS_Control.ino
+#define STATS_CALLERS 5
+#define STATS_HISTOGRAM_BUCKETS 8
+#define STATS_HISTOGRAM_BASE_US 128
+#define STATS_CALLER_SIZE 22          // I2CBBCallerStats: 4 32-bit and 3 16-bit counts
+static const char* const callerNames[STATS_CALLERS] = { "boot", "remote", "format", "verify", "console" };
+
+static int inputFd = -1;   // from the board
+static int outputFd = -1;  // to the board
+static pid_t standIn = -1;
+
+
+static bool openSerialPort(const char* device) {
+  int fd = open(device, O_RDWR | O_NOCTTY);
+  if(fd < 0) {
+    std::cerr << "could not open " << device << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  struct termios settings;
+  if(tcgetattr(fd, &settings) != 0) {
+    std::cerr << device << " is not a serial port" << std::endl;
+    close(fd);
+    return false;
+  }
+
+  cfmakeraw(&settings);
+  cfsetispeed(&settings, B38400);  // CONSOLE_BAUD
+  cfsetospeed(&settings, B38400);
+  settings.c_cflag |= CLOCAL | CREAD;
+  settings.c_cflag &= ~(CSTOPB | CRTSCTS);
+  settings.c_cc[VMIN] = 0;
+  settings.c_cc[VTIME] = 0;
+  tcsetattr(fd, TCSANOW, &settings);
+  tcflush(fd, TCIOFLUSH);
+
+  inputFd = outputFd = fd;
+  return true;
+}
+
+
+static bool startStandIn(const char* commandLine) {
+  int toChild[2], fromChild[2];
+  if(pipe(toChild) != 0 || pipe(fromChild) != 0) {
+    std::cerr << "could not create pipes" << std::endl;
+    return false;
+  }
+
+  standIn = fork();
+  if(standIn < 0) {
+    std::cerr << "could not start " << commandLine << std::endl;
+    return false;
+  }
+
+  if(standIn == 0) {
+    dup2(toChild[0], 0);
+    dup2(fromChild[1], 1);
+    close(toChild[1]);
+    close(fromChild[0]);
+    execl("/bin/sh", "sh", "-c", commandLine, (char*)NULL);
+    _exit(127);
+  }
+
+  close(toChild[0]);
+  close(fromChild[1]);
+  signal(SIGPIPE, SIG_IGN);
+  inputFd = fromChild[0];
+  outputFd = toChild[1];
+  return true;
+}
+
+
+static void closePort() {
+  if(outputFd != inputFd) {
+    close(outputFd);  // a stand-in exits at the end of its input
+  }
+  close(inputFd);
+
+  if(standIn > 0) {
+    waitpid(standIn, NULL, 0);
+  }
+}
+
+
+static uint8_t crc8Update(uint8_t crc, uint8_t data) {
+  // avr-libc's _crc8_ccitt_update
+  crc ^= data;
+  for(int i = 0; i < 8; i++) {
+    crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+
+static bool receiveByte(uint8_t* value) {
+  struct pollfd input = { inputFd, POLLIN, 0 };
+  return poll(&input, 1, RESPONSE_TIMEOUT_MS) > 0 && read(inputFd, value, 1) == 1;
+}
+
+
+static uint8_t exchange(uint8_t command, const std::vector<uint8_t>& payload, std::vector<uint8_t>& response) {
+  // sends one request and returns the status of its response (NO_RESPONSE if there was none or it was corrupted)
+  std::vector<uint8_t> frame;
+  frame.push_back(CONSOLE_SYNC);
+  frame.push_back(command);
+  frame.push_back((uint8_t)payload.size());
+  frame.insert(frame.end(), payload.begin(), payload.end());
+
+  uint8_t crc = 0;
+  for(size_t i = 1; i < frame.size(); i++) {
+    crc = crc8Update(crc, frame[i]);
+  }
+  frame.push_back(crc);
+
+  if(write(outputFd, frame.data(), frame.size()) != (ssize_t)frame.size()) {
+    return NO_RESPONSE;
+  }
+
+  // anything before the sync byte is left over from an earlier exchange
+  uint8_t value;
+  do {
+    if(!receiveByte(&value)) {
+      return NO_RESPONSE;
+    }
+  } while(value != CONSOLE_SYNC);
+
+  uint8_t length, status, receivedCrc;
+  if(!receiveByte(&length)) {
+    return NO_RESPONSE;
+  }
+
+  crc = crc8Update(0, length);
+  response.clear();
+  for(int i = 0; i < length; i++) {
+    if(!receiveByte(&value)) {
+      return NO_RESPONSE;
+    }
+    response.push_back(value);
+    crc = crc8Update(crc, value);
+  }
+
+  if(!receiveByte(&status) || !receiveByte(&receivedCrc) || crc8Update(crc, status) != receivedCrc) {
+    return NO_RESPONSE;
+  }
+
+  return status;
+}
+
+
+static bool sendRequest(uint8_t command, const std::vector<uint8_t>& payload, std::vector<uint8_t>& response) {
+  // sends the request until it gets through, returns false if it never did or it failed on the board
+  static const char* const statusNames[] = { "ok", "corrupted request", "bad command", "I2C bus error",
+                                             "request timed out", "request overrun" };
+  uint8_t status = NO_RESPONSE;
+
+  for(int attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+    status = exchange(command, payload, response);
+    if(status == CONSOLE_OK) {
+      return true;
+    }
+    if(status == CONSOLE_ERROR_COMMAND || status == CONSOLE_ERROR_BUS) {
+      break;  // sending it again won't help
+    }
+  }
+
+  if(status < sizeof(statusNames) / sizeof(statusNames[0])) {
+    std::cerr << "failed: " << statusNames[status] << std::endl;
+  } else {
+    std::cerr << "failed: no answer" << std::endl;
+  }
+  return false;
+}
+
+
+static bool readRegisters(int segment, int firstRegister, int count, std::vector<uint8_t>& values) {
+  std::vector<uint8_t> payload;
+  payload.push_back((uint8_t)segment);
+  payload.push_back((uint8_t)firstRegister);
+  payload.push_back((uint8_t)count);
+  return sendRequest(CONSOLE_READ, payload, values) && (int)values.size() == count;
+}
+
+
+static bool writeRegisters(int segment, int firstRegister, const uint8_t* values, int count) {
+  std::vector<uint8_t> payload, response;
+  payload.push_back((uint8_t)segment);
+  payload.push_back((uint8_t)firstRegister);
+  payload.push_back((uint8_t)count);
+  payload.push_back(crc8Update(crc8Update(crc8Update(0, payload[0]), payload[1]), payload[2]));
+
+  // the values in chunks, each followed by its own CRC
+  for(int offset = 0; offset < count; offset += CONSOLE_WRITE_CHUNK) {
+    int chunk = (count - offset < CONSOLE_WRITE_CHUNK) ? count - offset : CONSOLE_WRITE_CHUNK;
+    uint8_t crc = 0;
+    for(int i = 0; i < chunk; i++) {
+      payload.push_back(values[offset + i]);
+      crc = crc8Update(crc, values[offset + i]);
+    }
+    payload.push_back(crc);
+  }
+  return sendRequest(CONSOLE_WRITE, payload, response);
+}
+
+
+static void printRegisters(int firstRegister, const std::vector<uint8_t>& values) {
+  for(size_t i = 0; i < values.size(); i++) {
+    int reg = firstRegister + (int)i;
+    if(i == 0 || reg % 16 == 0) {
+      printf("%s%02x:", (i == 0) ? "" : "\n", reg & ~15);
+      for(int gap = reg & 15; gap > 0; gap--) {
+        printf("   ");
+      }
+    }
+    printf(" %02x", values[i]);
+  }
+  printf("\n");
+}
+
+
+static bool parseNumber(const char* text, int max, int* value) {
+  char* end = NULL;
+  long number = strtol(text, &end, 0);
+  if(end == text || *end != '\0' || number < 0 || number > max) {
+    std::cerr << "not a number from 0 to " << max << ": " << text << std::endl;
+    return false;
+  }
+  *value = (int)number;
+  return true;
+}
+
+
+static bool readProgramArray(const char* fileName, std::vector<uint8_t>& program) {
+  // the numbers of a .set file or between the braces of a program array header, without comments
+  std::ifstream file(fileName);
+  if(!file) {
+    std::cerr << "could not open " << fileName << std::endl;
+    return false;
+  }
+
+  std::stringstream contents;
+  contents << file.rdbuf();
+  std::string text = contents.str();
+
+  size_t open = text.find('{');
+  if(open != std::string::npos) {
+    size_t close = text.rfind('}');
+    text = text.substr(open + 1, (close == std::string::npos || close < open) ? std::string::npos : close - open - 1);
+  }
+
+  size_t i = 0;
+  while(i < text.size()) {
+    if(text.compare(i, 2, "//") == 0) {
+      i = text.find('\n', i);
+    } else if(text.compare(i, 2, "/*") == 0) {
+      i = text.find("*/", i);
+      i = (i == std::string::npos) ? i : i + 2;
+    } else if(isdigit((unsigned char)text[i])) {
+      char* end = NULL;
+      long value = strtol(text.c_str() + i, &end, 0);
+      if(value > 255) {
+        std::cerr << fileName << ": value " << value << " does not fit in a byte" << std::endl;
+        return false;
+      }
+      program.push_back((uint8_t)value);
+      i = end - text.c_str();
+    } else if(text[i] == ',' || isspace((unsigned char)text[i])) {
+      i++;
+    } else {
+      std::cerr << fileName << ": unexpected '" << text[i] << "'" << std::endl;
+      return false;
+    }
+  }
+
+  if(program.size() != NUM_SEGMENTS*SEGMENT_SIZE) {
+    std::cerr << fileName << ": expected " << NUM_SEGMENTS*SEGMENT_SIZE << " values (" << NUM_SEGMENTS << " segments of "
+              << SEGMENT_SIZE << " registers), found " << program.size() << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+
+static int ping() {
+  std::vector<uint8_t> payload, response;
+  if(!sendRequest(CONSOLE_PING, payload, response) || response.size() != 1) {
+    return 1;
+  }
+  printf("protocol version %d\n", response[0]);
+  return 0;
+}
+
+
+static int peek(int argc, char** argv) {
+  int segment, firstRegister, count = 1;
+  if(argc < 2 || argc > 3 || !parseNumber(argv[0], NUM_SEGMENTS - 1, &segment) ||
+     !parseNumber(argv[1], SEGMENT_SIZE - 1, &firstRegister) || (argc == 3 && !parseNumber(argv[2], CONSOLE_MAX_PAYLOAD, &count))) {
+    return -1;
+  }
+
+  std::vector<uint8_t> values;
+  if(count == 0 || !readRegisters(segment, firstRegister, count, values)) {
+    return 1;
+  }
+  printRegisters(firstRegister, values);
+  return 0;
+}
+
+
+static int poke(int argc, char** argv) {
+  int segment, firstRegister;
+  if(argc < 3 || CONSOLE_WRITE_RUN_SIZE(argc - 2) > CONSOLE_MAX_PAYLOAD || !parseNumber(argv[0], NUM_SEGMENTS - 1, &segment) ||
+     !parseNumber(argv[1], SEGMENT_SIZE - 1, &firstRegister)) {
+    return -1;
+  }
+
+  std::vector<uint8_t> values;
+  for(int i = 2; i < argc; i++) {
+    int value;
+    if(!parseNumber(argv[i], 255, &value)) {
+      return -1;
+    }
+    values.push_back((uint8_t)value);
+  }
+
+  return writeRegisters(segment, firstRegister, values.data(), (int)values.size()) ? 0 : 1;
+}
+
+
+static bool readSegment(int segment, std::vector<uint8_t>& values) {
+  // two reads, a response holds up to 255 values
+  std::vector<uint8_t> high;
+  if(!readRegisters(segment, 0x00, SEGMENT_SIZE / 2, values) || !readRegisters(segment, SEGMENT_SIZE / 2, SEGMENT_SIZE / 2, high)) {
+    return false;
+  }
+  values.insert(values.end(), high.begin(), high.end());
+  return true;
+}
+
+
+static int dump(int argc, char** argv) {
+  int first = 0, last = NUM_SEGMENTS - 1;
+  if(argc > 1 || (argc == 1 && !parseNumber(argv[0], NUM_SEGMENTS - 1, &first))) {
+    return -1;
+  }
+  if(argc == 1) {
+    last = first;
+  }
+
+  for(int segment = first; segment <= last; segment++) {
+    std::vector<uint8_t> values;
+    if(!readSegment(segment, values)) {
+      return 1;
+    }
+    printf("segment %d\n", segment);
+    printRegisters(0x00, values);
+  }
+  return 0;
+}
+
+
+static int save(int argc, char** argv) {
+  if(argc != 1) {
+    return -1;
+  }
+
+  std::vector<uint8_t> registers;
+  for(int segment = 0; segment < NUM_SEGMENTS; segment++) {
+    std::vector<uint8_t> values;
+    if(!readSegment(segment, values)) {
+      return 1;
+    }
+    registers.insert(registers.end(), values.begin(), values.end());
+  }
+
+  std::ofstream file(argv[0]);
+  for(size_t i = 0; i < registers.size(); i++) {
+    file << (int)registers[i] << "\n";
+  }
+  if(!file) {
+    std::cerr << "could not write " << argv[0] << std::endl;
+    return 1;
+  }
+
+  printf("saved %d segments to %s\n", NUM_SEGMENTS, argv[0]);
+  return 0;
+}
+
+
+static int upload(int argc, char** argv) {
+  if(argc != 1) {
+    return -1;
+  }
+
+  std::vector<uint8_t> program;
+  if(!readProgramArray(argv[0], program)) {
+    return 1;
+  }
+
+  for(int segment = 0; segment < NUM_SEGMENTS; segment++) {
+    if(!writeRegisters(segment, 0x00, &program[segment * SEGMENT_SIZE], PROGRAMMED_REGISTERS_PER_SEGMENT)) {
+      std::cerr << "segment " << segment << " was not written" << std::endl;
+      return 1;
+    }
+  }
+
+  int differences = 0;
+  for(int segment = 0; segment < NUM_SEGMENTS; segment++) {
+    int firstRegister = (segment == 0) ? VERIFY_STATUS_REGISTERS : 0x00;
+    std::vector<uint8_t> values;
+    if(!readRegisters(segment, firstRegister, PROGRAMMED_REGISTERS_PER_SEGMENT - firstRegister, values)) {
+      std::cerr << "segment " << segment << " could not be read back" << std::endl;
+      return 1;
+    }
+
+    for(size_t i = 0; i < values.size(); i++) {
+      uint8_t expected = program[segment * SEGMENT_SIZE + firstRegister + i];
+      if(values[i] != expected) {
+        std::cerr << "segment " << segment << " register 0x" << std::hex << firstRegister + i << " is 0x" << (int)values[i]
+                  << " instead of 0x" << (int)expected << std::dec << std::endl;
+        differences++;
+      }
+    }
+  }
+
+  printf("uploaded %s, %d registers differ\n", argv[0], differences);
+  return differences == 0 ? 0 : 1;
+}
+
+
+static uint32_t littleEndian(const std::vector<uint8_t>& data, size_t offset, int size) {
+  uint32_t value = 0;
+  for(int i = size - 1; i >= 0; i--) {
+    value = (value << 8) | data[offset + i];
+  }
+  return value;
+}
+
+
+static int stats(int argc, char** argv) {
+  bool clear = false;
+  if(argc > 1 || (argc == 1 && !(clear = (strcmp(argv[0], "-c") == 0)))) {
+    return -1;
+  }
+
+  std::vector<uint8_t> payload, response;
+  payload.push_back(clear ? CONSOLE_STATS_CLEAR : 0);
+  if(!sendRequest(CONSOLE_I2C_STATS, payload, response)) {
+    std::cerr << "(is the sketch built with I2CBB_STATS set to 1?)" << std::endl;
+    return 1;
+  }
+  if(response.size() != STATS_CALLERS * STATS_CALLER_SIZE + STATS_HISTOGRAM_BUCKETS * 2) {
+    std::cerr << "unexpected stats size " << response.size() << std::endl;
+    return 1;
+  }
+
+  printf("%-8s %12s %12s %12s %12s %8s %8s %8s\n", "caller", "transactions", "bytes out", "bytes in", "busy us",
+         "nacks", "timeouts", "retries");
+  for(int caller = 0; caller < STATS_CALLERS; caller++) {
+    size_t offset = caller * STATS_CALLER_SIZE;
+    printf("%-8s %12u %12u %12u %12u %8u %8u %8u\n", callerNames[caller],
+           littleEndian(response, offset, 4), littleEndian(response, offset + 4, 4), littleEndian(response, offset + 8, 4),
+           littleEndian(response, offset + 12, 4), littleEndian(response, offset + 16, 2), littleEndian(response, offset + 18, 2),
+           littleEndian(response, offset + 20, 2));
+  }
+
+  printf("\ntransaction time\n");
+  for(int bucket = 0; bucket < STATS_HISTOGRAM_BUCKETS; bucket++) {
+    uint32_t count = littleEndian(response, STATS_CALLERS * STATS_CALLER_SIZE + bucket * 2, 2);
+    if(bucket < STATS_HISTOGRAM_BUCKETS - 1) {
+      printf("  < %6d us %8u\n", STATS_HISTOGRAM_BASE_US << bucket, count);
+    } else {
+      printf(" >= %6d us %8u\n", STATS_HISTOGRAM_BASE_US << (bucket - 1), count);
+    }
+  }
+  return 0;
+}
+
+
+static int status() {
+  std::vector<uint8_t> response;
+  if(!sendRequest(CONSOLE_STATUS, std::vector<uint8_t>(), response)) {
+    return 1;
+  }
+  if(response.size() != sizeof(ConsoleStatus)) {
+    std::cerr << "unexpected status size " << response.size() << std::endl;
+    return 1;
+  }
+
+#define STATUS_FIELD(field) littleEndian(response, offsetof(ConsoleStatus, field), sizeof(((ConsoleStatus*)0)->field))
+  uint8_t built = response[offsetof(ConsoleStatus, built)];
+  size_t bootWaits = offsetof(ConsoleStatus, bootWaitUs);
+
+  printf("boot: waited %.3f ms for the scaler before the start array, %.3f ms before the program array, %u timeouts\n",
+         littleEndian(response, bootWaits, 4) / 1e3, littleEndian(response, bootWaits + 4, 4) / 1e3,
+         STATUS_FIELD(bootWaitTimeouts));
+
+  if(built & CONSOLE_BUILT_SHADOW_VERIFY) {
+    printf("shadow: %u reads disagreed with the scaler\n", STATUS_FIELD(shadowMismatches));
+  } else {
+    printf("shadow: not checked (SHADOW_VERIFY is 0)\n");
+  }
+
+  if(built & CONSOLE_BUILT_FORMAT_DETECT) {
+    printf("input format: detected at %u ms, switching took %.3f ms, each poll %.3f ms\n",
+           STATUS_FIELD(formatDetectedMs), STATUS_FIELD(formatSwitchUs) / 1e3, STATUS_FIELD(formatPollUs) / 1e3);
+  } else {
+    printf("input format: not detected (AUTO_FORMAT_DETECTION is 0)\n");
+  }
+
+  if(built & CONSOLE_BUILT_PROGRAM_VERIFY) {
+    printf("verification: the last one took %.1f ms, %u banks rewritten, %u failures in all\n",
+           STATUS_FIELD(verifyPassUs) / 1e3, STATUS_FIELD(verifyBanksRewritten), STATUS_FIELD(verifyFailures));
+  } else {
+    printf("verification: off (PROGRAM_VERIFY is 0)\n");
+  }
+#undef STATUS_FIELD
+  return 0;
+}
+
+
+static void printUsage(const char* programName) {
+  std::cerr << "Usage: " << programName << " <serial device | exec:<command line>> <command> [<arguments>]" << std::endl;
+  std::cerr << "  commands: ping" << std::endl;
+  std::cerr << "            peek <segment> <register> [<count>]" << std::endl;
+  std::cerr << "            poke <segment> <register> <value> [...]" << std::endl;
+  std::cerr << "            dump [<segment>]" << std::endl;
+  std::cerr << "            save <set file>" << std::endl;
+  std::cerr << "            upload <set file or program array>" << std::endl;
+  std::cerr << "            stats [-c]" << std::endl;
+  std::cerr << "            status" << std::endl;
+}
+
+
+int main(int argc, char** argv) {
+  if(argc < 3) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  bool opened = (strncmp(argv[1], "exec:", 5) == 0) ? startStandIn(argv[1] + 5) : openSerialPort(argv[1]);
+  if(!opened) {
+    return 1;
+  }
+
+  int result = -1;
+  char* command = argv[2];
+  int commandArgc = argc - 3;
+  char** commandArgv = argv + 3;
+
+  if(strcmp(command, "ping") == 0 && commandArgc == 0) {
+    result = ping();
+  } else if(strcmp(command, "peek") == 0) {
+    result = peek(commandArgc, commandArgv);
+  } else if(strcmp(command, "poke") == 0) {
+    result = poke(commandArgc, commandArgv);
+  } else if(strcmp(command, "dump") == 0) {
+    result = dump(commandArgc, commandArgv);
+  } else if(strcmp(command, "save") == 0) {
+    result = save(commandArgc, commandArgv);
+  } else if(strcmp(command, "upload") == 0) {
+    result = upload(commandArgc, commandArgv);
+  } else if(strcmp(command, "stats") == 0) {
+    result = stats(commandArgc, commandArgv);
+  } else if(strcmp(command, "status") == 0 && commandArgc == 0) {
+    result = status();
+  }
+
+  closePort();
+
+  if(result < 0) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  return result;
+}
@@ -0,0 +1,326 @@
+#include "SimGbsScaler.h"
+#include <string.h>
+
+// fast mode minimums (ns), the fastest I2CBitBangerTiming.h profile
+#define SIM_MIN_SCL_HIGH 600
+#define SIM_MIN_SCL_LOW  1300
+
+// sync processor status registers (segment 0)
+#define SIM_STATUS_FIRST      0x16
+#define SIM_STATUS_LAST       0x1C
+#define SIM_STATUS_HSACT      (1<<1)  // TV5725 status 0x16 (0x0a with both)
+#define SIM_STATUS_VSACT      (1<<3)
+
+SimGbsScaler* SimGbsScaler::attached = 0;
+
+
+SimGbsScaler::SimGbsScaler(uint8_t sevenBitAddress) {
+  address = sevenBitAddress;
+  stretchTime = 0;
+  busyUntil = 0;
+  dropEvery = 0;
+  powerUpValues = 0;
+  memset(&stats, 0, sizeof(stats));
+  memset(&backgroundStats, 0, sizeof(backgroundStats));
+  powerUp();
+}
+
+
+void SimGbsScaler::powerUp() {
+  if(powerUpValues) {
+    memcpy(registers, powerUpValues, sizeof(registers));
+  } else {
+    memset(registers, 0, sizeof(registers));
+  }
+  segment = 0;
+  state = IDLE;
+  sdaPull = sclPull = false;
+  scl = sda = true;
+  shiftRegister = bitCount = 0;
+  byteCount = 0;
+  readMode = acked = false;
+  pointer = 0;
+  transactionStart = sclChanged = 0;
+  masterPullsScl = masterWaiting = false;
+  selectedSegment = false;
+  firstPointer = 0;
+  valuesWritten = 0;
+  inputFormat = SIM_INPUT_NONE;
+  inputSince = 0;
+  PINB = PINB.raw() | (1<<0) | (1<<2);
+}
+
+
+void SimGbsScaler::setInput(SimInputFormat format) {
+  inputFormat = format;
+  inputSince = simNow();
+}
+
+
+void SimGbsScaler::attach() {
+  attached = this;
+  simSetI2cLineHandler(lineHandler);
+}
+
+
+void SimGbsScaler::lineHandler() {
+  if(attached) {
+    attached->linesChanged();
+  }
+}
+
+
+void SimGbsScaler::linesChanged() {
+  // the slave's reaction to a change can change the lines again, so repeat until they settle
+  bool masterScl = simMasterPullsScl();
+  if(sclPull && masterScl != masterPullsScl) {
+    if(!masterScl) {
+      stats.clockStretches++;
+      masterWaiting = true;
+    } else if(masterWaiting) {
+      // the master carried on without waiting for SCL to go high
+      stats.stretchesIgnored++;
+      masterWaiting = false;
+    }
+  }
+  masterPullsScl = masterScl;
+  
+  for(int settle = 0; settle < 4; settle++) {
+    bool newScl = !(simMasterPullsScl() || sclPull);
+    bool newSda = !(simMasterPullsSda() || sdaPull);
+    
+    if(newScl == scl && newSda == sda) {
+      break;
+    }
+    
+    bool oldScl = scl, oldSda = sda;
+    scl = newScl;
+    sda = newSda;
+    
+    if(oldScl && newScl && oldSda != newSda) {
+      if(!newSda) {
+        // START (or repeated START)
+        if(state != IDLE) {
+          stats.repeatedStarts++;
+        } else {
+          beforeTransaction = stats;
+          stats.transactions++;
+          transactionStart = simNow();
+        }
+        state = RECEIVE;
+        bitCount = 0;
+        byteCount = 0;
+        shiftRegister = 0;
+        readMode = false;
+      } else {
+        // STOP
+        if(state != IDLE) {
+          stats.busyTime += simNow() - transactionStart;
+          stats.lastStop = simNow();
+          transactionDone();
+        }
+        state = IDLE;
+        sdaPull = false;
+      }
+      continue;
+    }
+    
+    if(oldScl != newScl) {
+      SimTime period = simNow() - sclChanged;
+      if(state != IDLE && period < (oldScl ? SIM_MIN_SCL_HIGH : SIM_MIN_SCL_LOW)) {
+        stats.timingViolations++;
+      }
+      sclChanged = simNow();
+      
+      if(newScl) {
+        sclRose();
+      } else {
+        sclFell();
+      }
+    }
+  }
+  
+  // what the master sees on PINB
+  uint8_t pins = PINB.raw() & ~((1<<0) | (1<<2));
+  PINB = pins | (sda ? (1<<0) : 0) | (scl ? (1<<2) : 0);
+}
+
+
+void SimGbsScaler::sclRose() {
+  if(state == RECEIVE) {
+    shiftRegister = (uint8_t)((shiftRegister << 1) | (sda ? 1 : 0));
+    bitCount++;
+  } else if(state == MASTER_ACK) {
+    acked = !sda;
+  }
+}
+
+
+void SimGbsScaler::sclFell() {
+  switch(state) {
+    case RECEIVE:
+      if(bitCount == 8) {
+        byteReceived();
+      }
+      break;
+    
+    case ACK:
+      // the ACK clock is over
+      sdaPull = false;
+      bitCount = 0;
+      shiftRegister = 0;
+      
+      if(stretchTime > 0) {
+        sclPull = true;
+        simSchedule(simNow() + stretchTime, [this]() { releaseStretch(); });
+      }
+      
+      if(readMode) {
+        state = TRANSMIT;
+        shiftRegister = readRegister();
+        sdaPull = !(shiftRegister & 0x80);
+      } else {
+        state = RECEIVE;
+      }
+      break;
+    
+    case TRANSMIT:
+      bitCount++;
+      if(bitCount < 8) {
+        sdaPull = !(shiftRegister & (0x80 >> bitCount));
+      } else {
+        sdaPull = false;
+        state = MASTER_ACK;
+      }
+      break;
+    
+    case MASTER_ACK:
+      if(acked) {
+        bitCount = 0;
+        shiftRegister = readRegister();
+        sdaPull = !(shiftRegister & 0x80);
+        state = TRANSMIT;
+      } else {
+        state = IGNORE; // until the STOP
+      }
+      break;
+    
+    default:
+      break;
+  }
+}
+
+
+void SimGbsScaler::byteReceived() {
+  bool ack = true;
+  
+  if(byteCount == 0) {
+    readMode = (shiftRegister & 0x01) != 0;
+    ack = ((shiftRegister >> 1) == address) && simNow() >= busyUntil;
+  } else if(byteCount == 1) {
+    pointer = shiftRegister;
+    firstPointer = pointer;
+  } else {
+    if(pointer == SIM_GBS_SEGMENT_SELECT) {
+      segment = shiftRegister;
+    } else if(segment < SIM_GBS_SEGMENTS) {
+      valuesWritten++;
+      if(dropEvery == 0 || valuesWritten % dropEvery != 0) {
+        registers[segment][pointer] = shiftRegister;
+      }
+    }
+    pointer++;
+  }
+  
+  stats.bytesWritten++;
+  byteCount++;
+  
+  if(ack) {
+    sdaPull = true;
+    state = ACK;
+  } else {
+    stats.nacks++;
+    state = IGNORE;
+  }
+}
+
+
+uint8_t SimGbsScaler::readRegister() {
+  uint8_t value;
+  if(pointer == SIM_GBS_SEGMENT_SELECT) {
+    value = segment;
+  } else if(segment == 0 && pointer >= SIM_STATUS_FIRST && pointer <= SIM_STATUS_LAST) {
+    value = statusRegister(pointer);
+  } else if(segment < SIM_GBS_SEGMENTS) {
+    value = registers[segment][pointer];
+  } else {
+    value = 0xff;
+  }
+  pointer++;
+  stats.bytesRead++;
+  return value;
+}
+
+
+void SimGbsScaler::releaseStretch() {
+  sclPull = false;
+  masterWaiting = false;
+  linesChanged();
+}
+
+
+uint8_t SimGbsScaler::statusRegister(uint8_t reg) {
+  // what the sync processor measured over the last complete field
+  SimTime fields = (simNow() - inputSince) / SIM_FIELD_PERIOD;
+  bool locked = inputFormat != SIM_INPUT_NONE && fields >= SIM_SYNC_LOCK_FIELDS;
+  uint16_t htotal = 0;   // 27MHz clocks per line
+  uint16_t vtotal = 0;   // lines per field
+  
+  if(locked) {
+    switch(inputFormat) {
+      case SIM_INPUT_240P: htotal = 1716; vtotal = 262; break;
+      case SIM_INPUT_480I: htotal = 1716; vtotal = 262 + (fields & 1); break;
+      case SIM_INPUT_480P: htotal = 858;  vtotal = 525; break;
+      default: break;
+    }
+  }
+  
+  switch(reg) {
+    case 0x16: return locked ? (SIM_STATUS_HSACT | SIM_STATUS_VSACT) : 0;
+    case 0x17: return htotal & 0xff;
+    case 0x18: return htotal >> 8;
+    case 0x19: return locked ? 0x7e : 0;   // hsync low length
+    case 0x1B: return vtotal & 0xff;
+    case 0x1C: return vtotal >> 8;
+    default:   return 0;
+  }
+}
+
+
+static void moveStats(SimBusStats& from, SimBusStats& to, const SimBusStats& base) {
+  // moves everything from counted since base over to to
+  to.transactions += from.transactions - base.transactions;
+  to.repeatedStarts += from.repeatedStarts - base.repeatedStarts;
+  to.bytesWritten += from.bytesWritten - base.bytesWritten;
+  to.bytesRead += from.bytesRead - base.bytesRead;
+  to.nacks += from.nacks - base.nacks;
+  to.clockStretches += from.clockStretches - base.clockStretches;
+  to.stretchesIgnored += from.stretchesIgnored - base.stretchesIgnored;
+  to.timingViolations += from.timingViolations - base.timingViolations;
+  to.busyTime += from.busyTime - base.busyTime;
+  to.lastStop = from.lastStop;
+  from = base;
+}
+
+
+void SimGbsScaler::transactionDone() {
+  // a read is the sketch checking on the scaler, and so is a segment select right before it
+  bool select = !readMode && byteCount == 3 && firstPointer == SIM_GBS_SEGMENT_SELECT;
+  
+  if(readMode) {
+    moveStats(stats, backgroundStats, selectedSegment ? beforeSelect : beforeTransaction);
+  }
+  
+  selectedSegment = select;
+  beforeSelect = beforeTransaction;
+}
@@ -0,0 +1,109 @@
+/*
+  Simulated I2C bus with a GBS 8200/8220 scaler on it (see gbsSimulator.cpp)
+
+  The bus is open drain: a line is low while the master (DDRB set, PORTB clear) or the slave pulls it.
+  The scaler model answers at its 7-bit address with:
+    - 6 segments of 256 registers, register 0xF0 selects the segment (and reads back as it)
+    - a register pointer set by the first byte of a write, auto-incremented by every data byte
+      that is written or read (reads start at the pointer, e.g. after a repeated START)
+    - ACK of its address and every written byte, NACK of other addresses
+    - optional clock stretching after every ACK and a busy period after power up (NACKs its address)
+    - the sync processor status registers (segment 0, 0x16 - 0x1C) for a simulated video input
+      (setInput), locked SIM_SYNC_LOCK_FIELDS fields after the input changes
+
+  Reads (with the segment select just before them, if there was one) are the sketch checking on the
+  scaler in the background (input format polls, readback verification); they are counted in
+  backgroundStats rather than stats so the traffic of the actions stays comparable.
+  For testing the verification, every dropEvery-th register value written can be ignored (still ACKed).
+
+  Besides the register file it keeps counts of what happened on the bus and flags anything the
+  master did that breaks the protocol or the (fast mode) timing.
+*/
+
+#ifndef SimGbsScaler_h
+#define SimGbsScaler_h
+
+#include "SimHardware.h"
+
+#define SIM_GBS_SEGMENTS 6
+#define SIM_GBS_SEGMENT_SIZE 256
+#define SIM_GBS_SEGMENT_SELECT 0xF0
+
+#define SIM_FIELD_PERIOD     16683333LL  // ns, 59.94 fields per second
+#define SIM_SYNC_LOCK_FIELDS 2
+
+enum SimInputFormat { SIM_INPUT_NONE, SIM_INPUT_240P, SIM_INPUT_480I, SIM_INPUT_480P };
+
+struct SimBusStats {
+  uint32_t transactions;     // START ... STOP
+  uint32_t repeatedStarts;
+  uint32_t bytesWritten;     // by the master, including addresses
+  uint32_t bytesRead;
+  uint32_t nacks;            // bytes the slave did not ACK
+  uint32_t clockStretches;   // times the master released SCL while the slave held it low
+  uint32_t stretchesIgnored; // ...and pulled it low again before the slave let go (a lost clock)
+  uint32_t timingViolations; // SCL high/low periods shorter than the fast mode minimum
+  SimTime busyTime;          // time between START and STOP
+  SimTime lastStop;
+};
+
+class SimGbsScaler {
+  public:
+    SimGbsScaler(uint8_t sevenBitAddress);
+    
+    void attach();            // connects the model to the simulated PB0 (SDA) and PB2 (SCL)
+    void powerUp();           // registers to powerUpValues (0 if there are none), segment 0
+    void setInput(SimInputFormat format);  // the video input changes to format now
+    
+    uint8_t registers[SIM_GBS_SEGMENTS][SIM_GBS_SEGMENT_SIZE];
+    uint8_t segment;
+    
+    SimTime stretchTime;      // how long SCL is held low after each ACK (0 = never)
+    SimTime busyUntil;        // the address is NACKed until then
+    uint32_t dropEvery;       // every dropEvery-th register value written is lost (0 = none)
+    const uint8_t* powerUpValues;  // SIM_GBS_SEGMENTS*SIM_GBS_SEGMENT_SIZE register values after power up (NULL = all 0)
+    
+    SimBusStats stats;
+    SimBusStats backgroundStats;
+    
+  private:
+    enum State { IDLE, RECEIVE, ACK, TRANSMIT, MASTER_ACK, IGNORE };
+    
+    void linesChanged();
+    void sclRose();
+    void sclFell();
+    void byteReceived();
+    uint8_t readRegister();
+    uint8_t statusRegister(uint8_t reg);
+    void transactionDone();
+    void releaseStretch();
+    
+    static void lineHandler();
+    static SimGbsScaler* attached;
+    
+    uint8_t address;
+    State state;
+    bool sdaPull, sclPull;    // lines the slave holds low
+    bool scl, sda;            // current line levels
+    uint8_t shiftRegister;
+    uint8_t bitCount;
+    uint16_t byteCount;       // bytes since the last START (0 = address)
+    bool readMode;
+    bool acked;
+    uint8_t pointer;
+    
+    SimTime transactionStart;
+    SimBusStats beforeTransaction;  // stats at the START of the transaction
+    bool selectedSegment;           // the transaction before this one was a segment select (counted in stats so far)
+    SimBusStats beforeSelect;       // ...and stats before it
+    uint8_t firstPointer;           // the register the transaction started at
+    uint32_t valuesWritten;
+    SimTime sclChanged;
+    bool masterPullsScl;
+    bool masterWaiting;       // the master released SCL while the slave was stretching it
+    
+    SimInputFormat inputFormat;
+    SimTime inputSince;
+};
+
+#endif
@@ -0,0 +1,398 @@
+#include "SimHardware.h"
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <map>
+#include <deque>
+
+static SimTime now = 0;
+static bool inInterrupt = false;
+static bool pinChangePending = false;
+static std::multimap<SimTime, std::function<void()> > events;
+static void (*i2cLineHandler)() = 0;
+static uint8_t eeprom[512];
+static bool eepromErased = false;
+
+// the timer is counting from timer1Start (in CTC mode it is cleared every time it reaches OCR1A)
+static SimTime timer1Start = 0;
+
+// the sketch's ISRs, weak so a sketch built without one (e.g. with I2CBB_ASYNC_ENABLED 0) still links,
+// like the AVR's default handler for an interrupt that is never enabled
+extern "C" __attribute__((weak)) void SIM_TIMER1_COMPA_VECTOR(void) {}
+extern "C" __attribute__((weak)) void SIM_PCINT0_VECTOR(void) {}
+extern "C" __attribute__((weak)) void SIM_LIN_TC_VECTOR(void) {}
+
+// the LIN/UART
+#define LIN_FLAGS    0x0F    // LINSIR bits that are cleared by writing a 1 (and LINENIR bits enabling them)
+static uint8_t uartReceived = 0;
+static SimTime uartReceiveFree = 0;   // when the line from the host is free for the next byte
+static SimTime uartTransmitFree = 0;  // when the byte being sent has gone out
+static std::deque<uint8_t> uartTransmitted;
+static uint32_t uartOverruns = 0;
+
+
+static void pinsBWritten(uint8_t oldValue) {
+  (void)oldValue;
+  if(i2cLineHandler) {
+    i2cLineHandler();
+  }
+}
+
+static void ddrBWritten(uint8_t oldValue) {
+  pinsBWritten(oldValue);
+  simAdvance(SIM_LINE_CHANGE_CYCLES * SIM_NS_PER_CYCLE);
+}
+
+static void sregWritten(uint8_t oldValue) {
+  (void)oldValue;
+  simInterruptsChanged();
+}
+
+static uint8_t pinRead(uint8_t value) {
+  simAdvance(SIM_PIN_READ_CYCLES * SIM_NS_PER_CYCLE);
+  return value;
+}
+
+static void linCrWritten(uint8_t oldValue);
+static void linSirWritten(uint8_t oldValue);
+static void linDatWritten(uint8_t oldValue);
+static uint8_t linDatRead(uint8_t value);
+
+SimRegister DDRA, PORTA, PINA(0, pinRead), DDRB(ddrBWritten), PORTB(pinsBWritten), PINB(0, pinRead), SREG(sregWritten);
+SimCounter16 TCNT1;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1, PCMSK0, PCMSK1, PCICR, PCIFR;
+volatile uint16_t OCR1A;
+SimRegister LINCR(linCrWritten), LINSIR(linSirWritten), LINENIR(sregWritten), LINBTR, LINDAT(linDatWritten, linDatRead);
+volatile uint16_t LINBRR;
+
+
+SimRegister::SimRegister(void (*onWriteArg)(uint8_t), uint8_t (*onReadArg)(uint8_t)) {
+  value = 0;
+  onWrite = onWriteArg;
+  onRead = onReadArg;
+}
+
+SimRegister::operator uint8_t() const {
+  return onRead ? onRead(value) : value;
+}
+
+SimRegister& SimRegister::operator=(uint8_t newValue) {
+  uint8_t oldValue = value;
+  value = newValue;
+  if(onWrite) {
+    onWrite(oldValue);
+  }
+  return *this;
+}
+
+
+static SimTime timer1TickNs() {
+  // prescaler from the clock select bits (0 = stopped)
+  static const SimTime prescalers[] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+  return prescalers[TCCR1B & 0x07] * SIM_NS_PER_CYCLE;
+}
+
+SimCounter16::operator uint16_t() const {
+  SimTime tick = timer1TickNs();
+  return tick ? (uint16_t)((now - timer1Start) / tick) : 0;
+}
+
+SimCounter16& SimCounter16::operator=(uint16_t newValue) {
+  timer1Start = now - newValue * timer1TickNs();
+  return *this;
+}
+
+
+static bool interruptsEnabled() {
+  return (SREG.raw() & 0x80) && !inInterrupt;
+}
+
+static SimTime nextTimer1Interrupt() {
+  // CTC mode only (WGM12), the compare match clears the counter
+  SimTime tick = timer1TickNs();
+  if(tick == 0 || !(TIMSK1 & (1<<OCIE1A)) || !(TCCR1B & (1<<WGM12))) {
+    return -1;
+  }
+  return timer1Start + ((SimTime)OCR1A + 1) * tick;
+}
+
+static void runTimer1Interrupt(SimTime due) {
+  timer1Start = due;
+  simEnterInterrupt();
+  SIM_TIMER1_COMPA_VECTOR();
+  simLeaveInterrupt();
+}
+
+static void runPinChangeInterrupt() {
+  pinChangePending = false;
+  simEnterInterrupt();
+  SIM_PCINT0_VECTOR();
+  simLeaveInterrupt();
+}
+
+
+static bool linInterruptPending() {
+  return (LINCR.raw() & (1<<LENA)) && (LINSIR.raw() & LINENIR.raw() & LIN_FLAGS);
+}
+
+static void runLinInterrupt() {
+  simEnterInterrupt();
+  SIM_LIN_TC_VECTOR();
+  simLeaveInterrupt();
+}
+
+
+void simEnterInterrupt() {
+  inInterrupt = true;
+}
+
+void simLeaveInterrupt() {
+  inInterrupt = false;
+  simInterruptsChanged();
+}
+
+void simInterruptsChanged() {
+  // run anything that became due while interrupts were disabled
+  while(interruptsEnabled()) {
+    SimTime timerDue = nextTimer1Interrupt();
+    if(pinChangePending) {
+      runPinChangeInterrupt();
+    } else if(timerDue >= 0 && timerDue <= now) {
+      runTimer1Interrupt(timerDue);
+    } else if(linInterruptPending()) {
+      runLinInterrupt();
+    } else {
+      break;
+    }
+  }
+}
+
+
+SimTime simNow() {
+  return now;
+}
+
+void simAdvanceTo(SimTime target) {
+  while(true) {
+    SimTime next = target;
+    int kind = 0;  // 0 = none, 1 = timer, 2 = event
+    
+    SimTime timerDue = nextTimer1Interrupt();
+    if(interruptsEnabled() && timerDue >= 0 && timerDue <= next) {
+      next = timerDue;
+      kind = 1;
+    }
+    if(!events.empty() && events.begin()->first <= next) {
+      next = events.begin()->first;
+      kind = 2;
+    }
+    
+    if(kind == 0) {
+      break;
+    }
+    
+    if(next > now) {
+      now = next;
+    }
+    
+    if(kind == 1) {
+      runTimer1Interrupt(timerDue);
+    } else {
+      std::function<void()> event = events.begin()->second;
+      events.erase(events.begin());
+      event();
+      simInterruptsChanged();
+    }
+  }
+  
+  // an interrupt may have taken us past the target
+  if(target > now) {
+    now = target;
+  }
+}
+
+void simAdvance(SimTime duration) {
+  simAdvanceTo(now + duration);
+}
+
+void simWait() {
+  // nothing changes until the next interrupt or event
+  SimTime next = now + SIM_NS_PER_CYCLE;
+  SimTime timerDue = nextTimer1Interrupt();
+  if(timerDue > next) {
+    next = timerDue;
+  }
+  simAdvanceTo(next);
+}
+
+void simSchedule(SimTime time, std::function<void()> event) {
+  events.insert(std::make_pair(time, event));
+}
+
+
+static void setPinA(uint8_t bit, bool high) {
+  uint8_t value = PINA.raw();
+  uint8_t newValue = high ? (value | (1<<bit)) : (value & ~(1<<bit));
+  if(newValue == value) {
+    return;
+  }
+  PINA = newValue;
+  
+  if((PCICR & (1<<PCIE0)) && (PCMSK0 & (1<<bit))) {
+    pinChangePending = true;
+    simInterruptsChanged();
+  }
+}
+
+void simSetIrPin(bool high) {
+  setPinA(5, high);
+}
+
+void simSetResolutionSwitch(bool high) {
+  setPinA(7, high);
+}
+
+
+static SimTime uartByteTime() {
+  // 10 bits (start, 8 data, stop) of LBT samples each, LBT is 32 unless LDISR is set
+  uint8_t samples = (LINBTR.raw() & (1<<LDISR)) ? (LINBTR.raw() & 0x3F) : 32;
+  return 10 * samples * ((SimTime)LINBRR + 1) * SIM_NS_PER_CYCLE;
+}
+
+static bool uartEnabled(uint8_t commandBits) {
+  // LCMD2 selects UART mode, LCMD1 enables the receiver and LCMD0 the transmitter
+  uint8_t command = (1<<LCMD2) | commandBits;
+  return (LINCR.raw() & (1<<LENA)) && (LINCR.raw() & command) == command;
+}
+
+static void uartByteArrived(uint8_t value) {
+  if(!uartEnabled(1<<LCMD1)) {
+    return;
+  }
+  if(LINSIR.raw() & (1<<LRXOK)) {
+    uartOverruns++;
+  }
+  uartReceived = value;
+  LINSIR.set(LINSIR.raw() | (1<<LRXOK));
+}
+
+static void linCrWritten(uint8_t oldValue) {
+  (void)oldValue;
+  if(LINCR.raw() & (1<<LSWRES)) {
+    // a software reset, the bit clears itself
+    LINCR.set(0);
+    LINSIR.set(0);
+    LINENIR.set(0);
+  }
+}
+
+static void linSirWritten(uint8_t oldValue) {
+  // the flags are cleared by writing a 1 to them, the rest is read only
+  LINSIR.set(oldValue & ~(LINSIR.raw() & LIN_FLAGS));
+}
+
+static void linDatWritten(uint8_t oldValue) {
+  (void)oldValue;
+  if(!uartEnabled(1<<LCMD0)) {
+    return;
+  }
+  uint8_t value = LINDAT.raw();
+  LINSIR.set(LINSIR.raw() & ~(1<<LTXOK));
+  uartTransmitFree = (uartTransmitFree > now ? uartTransmitFree : now) + uartByteTime();
+  simSchedule(uartTransmitFree, [value]() {
+    uartTransmitted.push_back(value);
+    LINSIR.set(LINSIR.raw() | (1<<LTXOK));
+  });
+}
+
+static uint8_t linDatRead(uint8_t value) {
+  // in UART mode reading the received byte clears LRXOK
+  (void)value;
+  LINSIR.set(LINSIR.raw() & ~(1<<LRXOK));
+  return uartReceived;
+}
+
+void simUartReceive(const uint8_t* data, int count) {
+  for(int i = 0; i < count; i++) {
+    uint8_t value = data[i];
+    uartReceiveFree = (uartReceiveFree > now ? uartReceiveFree : now) + uartByteTime();
+    simSchedule(uartReceiveFree, [value]() { uartByteArrived(value); });
+  }
+}
+
+int simUartTransmitted(uint8_t* data, int size) {
+  int count = 0;
+  while(count < size && !uartTransmitted.empty()) {
+    data[count++] = uartTransmitted.front();
+    uartTransmitted.pop_front();
+  }
+  return count;
+}
+
+uint32_t simUartOverruns() {
+  return uartOverruns;
+}
+
+
+void simSetI2cLineHandler(void (*handler)()) {
+  i2cLineHandler = handler;
+}
+
+bool simMasterPullsScl() {
+  return (DDRB.raw() & (1<<2)) && !(PORTB.raw() & (1<<2));
+}
+
+bool simMasterPullsSda() {
+  return (DDRB.raw() & (1<<0)) && !(PORTB.raw() & (1<<0));
+}
+
+
+uint8_t* simEeprom() {
+  if(!eepromErased) {
+    for(int i = 0; i < 512; i++) {
+      eeprom[i] = 0xff;
+    }
+    eepromErased = true;
+  }
+  return eeprom;
+}
+
+
+// Arduino core
+
+unsigned long millis() {
+  return (unsigned long)(now / 1000000);
+}
+
+unsigned long micros() {
+  return (unsigned long)(now / 1000);
+}
+
+void delay(unsigned long ms) {
+  simAdvance((SimTime)ms * 1000000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  simAdvance((SimTime)us * 1000);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+}
+
+EEPROMClass EEPROM;
+
+uint8_t EEPROMClass::read(int address) {
+  return simEeprom()[address & 511];
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  simEeprom()[address & 511] = value;
+  simAdvance(3400000);  // an EEPROM write takes 3.4 ms
+}
+
+void EEPROMClass::update(int address, uint8_t value) {
+  if(read(address) != value) {
+    write(address, value);
+  }
+}
@@ -0,0 +1,94 @@
+/*
+  Simulated ATtiny167 for the host build of GBS_Control (see gbsSimulator.cpp)
+
+  Time only moves when the code under test waits (_delay_us, delay, ...) or touches a simulated
+  I/O register, so the simulated time is what the code spends waiting plus
+  SIM_LINE_CHANGE_CYCLES for each change of DDRB (the cycles I2CBitBangerTiming.h allows for).
+  Everything else the CPU does is taken to be instant.
+
+  Interrupts (Timer1 compare A in CTC mode, pin change 0 and LIN/UART transfer complete) are run when
+  their time comes, as long as the I bit of SREG is set and no other interrupt is running.
+
+  The LIN/UART is only modelled in UART mode (8N1): bytes from the host arrive one byte time
+  (10 bits at the rate set by LINBTR and LINBRR) after another, and bytes written to LINDAT are
+  collected one byte time after they were written.
+*/
+
+#ifndef SimHardware_h
+#define SimHardware_h
+
+#include <stdint.h>
+#include <functional>
+
+#define SIM_F_CPU               16000000LL
+#define SIM_NS_PER_CYCLE        (1000000000LL / SIM_F_CPU)
+#define SIM_LINE_CHANGE_CYCLES  2
+#define SIM_PIN_READ_CYCLES     1
+
+typedef int64_t SimTime;  // nanoseconds
+
+// An 8 bit I/O register that can react to reads and writes
+class SimRegister {
+  public:
+    SimRegister(void (*onWriteArg)(uint8_t oldValue) = 0, uint8_t (*onReadArg)(uint8_t value) = 0);
+    
+    operator uint8_t() const;
+    SimRegister& operator=(uint8_t newValue);
+    SimRegister& operator|=(int bits) { return *this = (uint8_t)(value | bits); }
+    SimRegister& operator&=(int bits) { return *this = (uint8_t)(value & bits); }
+    SimRegister& operator^=(int bits) { return *this = (uint8_t)(value ^ bits); }
+    
+    uint8_t raw() const { return value; }
+    void set(uint8_t newValue) { value = newValue; }  // a change made by the hardware itself (no reaction)
+    
+  private:
+    uint8_t value;
+    void (*onWrite)(uint8_t oldValue);
+    uint8_t (*onRead)(uint8_t value);
+};
+
+// Timer1's counter, which counts from the time it was last written
+class SimCounter16 {
+  public:
+    operator uint16_t() const;
+    SimCounter16& operator=(uint16_t newValue);
+};
+
+extern SimRegister DDRA, PORTA, PINA, DDRB, PORTB, PINB, SREG;
+extern SimCounter16 TCNT1;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1, PCMSK0, PCMSK1, PCICR, PCIFR;
+extern volatile uint16_t OCR1A;
+extern SimRegister LINCR, LINSIR, LINENIR, LINBTR, LINDAT;
+extern volatile uint16_t LINBRR;
+
+
+// time
+SimTime simNow();
+void simAdvance(SimTime duration);     // lets duration pass, running interrupts and events as their time comes
+void simAdvanceTo(SimTime time);
+void simWait();                        // the code under test is spinning, move on to the next thing that can change
+void simSchedule(SimTime time, std::function<void()> event); // runs event at time (outside of the code under test)
+
+// pins driven from outside the chip
+void simSetIrPin(bool high);           // PA5
+void simSetResolutionSwitch(bool high); // PA7
+
+// the LIN/UART's other end
+void simUartReceive(const uint8_t* data, int count); // the bytes start arriving after anything still on its way
+int simUartTransmitted(uint8_t* data, int size);     // takes (up to size of) the bytes sent so far
+uint32_t simUartOverruns();                          // received bytes that replaced one the code hadn't read
+
+// called when the I2C pins change (set by the bus model)
+void simSetI2cLineHandler(void (*handler)());
+bool simMasterPullsScl();
+bool simMasterPullsSda();
+
+// interrupts
+void simInterruptsChanged();           // SREG was written
+void simEnterInterrupt();
+void simLeaveInterrupt();
+
+// EEPROM contents (512 bytes, erased to 0xff at start)
+uint8_t* simEeprom();
+
+#endif
@@ -0,0 +1,448 @@
+/*
+  Host simulation of GBS_Control driving a simulated GBS 8200/8220 over I2C
+
+  Builds the unmodified sketch, I2CBitBanger, NECIRReceiver, SettingsStore, PresetStream and RegisterConsole
+  for the host against the stand-ins in shims/ (a simulated ATtiny167, see SimHardware.h),
+  with the scaler on a simulated open drain bus (see SimGbsScaler.h).  The remote is simulated
+  too: each action is sent as NEC frames on the IR pin, so the decoder and loop() run as on the board.
+
+  For boot, each preset switch, each remote action and each change of the simulated video input it reports:
+    done      time from the IR frame being decoded (from power up for boot, from the change for the input)
+              to the last STOP on the bus
+    bus       time the bus was busy (START to STOP)
+    trans     transactions (START ... STOP), bytes written and read, NACKs
+    issues    lost clocks (SCL pulled low by the master while the slave was stretching it) and
+              SCL high/low periods shorter than the fast mode minimum
+    registers which program array registers 0x00 - 0xEF of every segment match, and a CRC of the whole register file
+  Reads of the scaler (input format polls, readback verification) are left out of these, they run in the
+  background; their share of the bus is reported after boot and each input change.
+  Times only count what the code waits for (see SimHardware.h), so they are a lower bound
+  that is comparable between builds: use it to check that a change to the programming code
+  makes things faster (or at least no slower) and leaves the same registers behind.
+
+  At the end it loads settings bank 1 and keeps it until it has been recorded for the next boot (see "Fast boot"
+  in GBS_Control.ino).  With -e the EEPROM is kept in a file, so a second run boots into it like the board
+  would after a power cycle.
+
+  With -c it reports nothing and runs the sketch in real time instead, with stdin and stdout as the
+  other end of its LIN/UART, as a stand-in for the board for the register console's host tool
+  (hostConsole/gbsConsole.cpp).  The console is off by default, build with -DREGISTER_CONSOLE=1 for this.
+
+  Build (from the GBS_Control folder):
+    g++ -std=gnu++11 -O2 -I hostSimulator/shims -o gbsSimulator hostSimulator/gbsSimulator.cpp \
+        hostSimulator/SimHardware.cpp hostSimulator/SimGbsScaler.cpp \
+        I2CBitBanger.cpp NECIRReceiver.cpp SettingsStore.cpp PresetStream.cpp RegisterConsole.cpp
+  The sketch's build options can be given as -D flags on top, e.g. -DI2CBB_ASYNC_ENABLED=0 to compare the
+  blocking program array writes with the Timer1 driven ones.
+
+  Usage:
+    gbsSimulator [-s <us>] [-b <us>] [-d <n>] [-p <set file>] [-e <file>] [-r] [-c]
+      -s <us>  the scaler stretches SCL for <us> microseconds after every ACK
+      -b <us>  the scaler NACKs its address for the first <us> microseconds after power up
+               (boot ACK polls it, each unanswered poll counts as a NACK)
+      -d <n>   the scaler ignores every <n>th register value written to it (readback verification repairs them)
+      -p <set file> the scaler powers up with these register values (6 segments of 256, one per line) instead
+               of 0, e.g. the ones saved from the board for gbsTableCompiler's boot command, so FAST_BOOT is
+               simulated with the values it was generated for (or, with others, how verification repairs it)
+      -e <file> read the EEPROM from the file (if it exists) before boot and write it back at the end
+      -r       print the final register file
+      -c       register console mode (see above)
+*/
+
+#include <Arduino.h>
+#include "../GBS_Control.ino"
+#include "SimGbsScaler.h"
+#include <stdio.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SIM_LOOP_OVERHEAD 20000LL  // ns between calls of loop()
+#define SIM_CONSOLE_DRAIN 1000000000LL  // ns the sketch runs for after the end of the console input
+
+// NEC remote timing (ns)
+#define NEC_BURST       562500LL
+#define NEC_START_BURST 9000000LL
+#define NEC_START_SPACE 4500000LL
+#define NEC_REPEAT_SPACE 2250000LL
+#define NEC_ONE_SPACE   1687500LL
+#define NEC_ZERO_SPACE  562500LL
+#define NEC_FRAME_PERIOD 108000000LL
+
+static SimGbsScaler* scaler = 0;
+static bool printRegisters = false;
+static bool consoleMode = false;
+static const char* eepromFile = 0;
+static uint8_t powerUpValues[SIM_GBS_SEGMENTS*SIM_GBS_SEGMENT_SIZE];
+
+
+static SimTime irLevel(SimTime time, bool high) {
+  simSchedule(time, [high]() { simSetIrPin(high); });
+  return time;
+}
+
+static SimTime sendNecFrame(SimTime time, uint8_t command) {
+  // returns the time the frame is decoded (the start of its final burst)
+  // address 0x00, its inverse, the command and its inverse, sent LSB first
+  uint32_t frame = 0x0000ff00UL | ((uint32_t)command << 16) | ((uint32_t)(uint8_t)~command << 24);
+  
+  irLevel(time, false);
+  time += NEC_START_BURST;
+  irLevel(time, true);
+  time += NEC_START_SPACE;
+  
+  for(int bit = 0; bit < 32; bit++) {
+    irLevel(time, false);
+    time += NEC_BURST;
+    irLevel(time, true);
+    time += (frame & ((uint32_t)1 << bit)) ? NEC_ONE_SPACE : NEC_ZERO_SPACE;
+  }
+  
+  SimTime decoded = irLevel(time, false);
+  time += NEC_BURST;
+  irLevel(time, true);
+  return decoded;
+}
+
+static SimTime sendNecRepeat(SimTime time) {
+  irLevel(time, false);
+  time += NEC_START_BURST;
+  irLevel(time, true);
+  time += NEC_REPEAT_SPACE;
+  SimTime decoded = irLevel(time, false);
+  time += NEC_BURST;
+  irLevel(time, true);
+  return decoded;
+}
+
+
+static void runSketch(SimTime until) {
+  while(simNow() < until) {
+    loop();
+    simAdvance(SIM_LOOP_OVERHEAD);
+  }
+}
+
+
+static uint32_t registerFileCrc() {
+  uint32_t crc = 0xffffffffUL;
+  for(int segment = 0; segment < SIM_GBS_SEGMENTS; segment++) {
+    for(int reg = 0; reg < SIM_GBS_SEGMENT_SIZE; reg++) {
+      crc ^= scaler->registers[segment][reg];
+      for(int i = 0; i < 8; i++) {
+        crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320UL : crc >> 1;
+      }
+    }
+  }
+  return ~crc;
+}
+
+static int registersDifferingFrom(const uint8_t* programArray) {
+  int differences = 0;
+  for(uint8_t segment = 0; segment < SIM_GBS_SEGMENTS; segment++) {
+    uint8_t values[PRESET_REGISTERS_PER_SEGMENT];
+    readProgramRegisters(programArray, segment, 0x00, PRESET_REGISTERS_PER_SEGMENT, values);
+    for(int reg = 0; reg < PRESET_REGISTERS_PER_SEGMENT; reg++) {
+      differences += (scaler->registers[segment][reg] != values[reg]);
+    }
+  }
+  return differences;
+}
+
+
+static void printHeading() {
+  printf("%-26s %9s %9s %6s %7s %6s %5s %6s %6s  %s\n",
+         "action", "done ms", "bus ms", "trans", "written", "read", "nacks", "lost", "timing", "registers");
+}
+
+static void report(const char* action, SimTime from, const SimBusStats& before) {
+  const SimBusStats& after = scaler->stats;
+  SimTime done = after.lastStop > from ? after.lastStop - from : 0;
+  
+  int from240p = registersDifferingFrom(programArray240p);
+  int from480i = registersDifferingFrom(programArray480i);
+  char state[64];
+  if(from240p <= from480i) {
+    snprintf(state, sizeof(state), "240p%s%d, crc %08x", from240p ? " +" : " ", from240p, (unsigned)registerFileCrc());
+  } else {
+    snprintf(state, sizeof(state), "480i%s%d, crc %08x", from480i ? " +" : " ", from480i, (unsigned)registerFileCrc());
+  }
+  
+  printf("%-26s %9.2f %9.2f %6u %7u %6u %5u %6u %6u  %s\n", action,
+         done / 1e6, (after.busyTime - before.busyTime) / 1e6,
+         after.transactions - before.transactions,
+         after.bytesWritten - before.bytesWritten,
+         after.bytesRead - before.bytesRead,
+         after.nacks - before.nacks,
+         after.stretchesIgnored - before.stretchesIgnored,
+         after.timingViolations - before.timingViolations,
+         state);
+}
+
+
+static void remoteAction(const char* action, const uint8_t* commands, int numCommands, int repeats) {
+  // sends the buttons one after the other (then repeat frames for the last one) and runs the sketch until things settle
+  SimBusStats before = scaler->stats;
+  SimTime time = simNow() + 1000000;
+  SimTime firstDecoded = 0;
+  SimTime lastDecoded = 0;
+  
+  for(int i = 0; i < numCommands + repeats; i++) {
+    lastDecoded = (i < numCommands) ? sendNecFrame(time, commands[i]) : sendNecRepeat(time);
+    if(i == 0) {
+      firstDecoded = lastDecoded;
+    }
+    time += NEC_FRAME_PERIOD;
+  }
+  
+  runSketch(lastDecoded + 1000000000LL);
+  report(action, firstDecoded, before);
+}
+
+static void press(const char* action, uint8_t command) {
+  remoteAction(action, &command, 1, 0);
+}
+
+
+static void reportBackground(const SimBusStats& before, SimTime duration) {
+  const SimBusStats& after = scaler->backgroundStats;
+  printf("  (background reads: %u transactions, %.1f%% of the bus; last verification took %.1f ms, %u banks rewritten, %u failures in all)\n",
+         after.transactions - before.transactions, 100.0 * (after.busyTime - before.busyTime) / duration,
+         verifyPassUs / 1e3, verifyBanksRewritten, verifyFailures);
+}
+
+
+static void changeInput(const char* action, SimInputFormat format) {
+  // changes the video input and runs the sketch until things settle
+  SimBusStats before = scaler->stats;
+  SimBusStats backgroundBefore = scaler->backgroundStats;
+  SimTime from = simNow() + 1000000;
+  unsigned long detectedBefore = formatDetectedMs;
+  
+  simSchedule(from, [format]() { scaler->setInput(format); });
+  runSketch(from + 1000000000LL);
+  report(action, from, before);
+  
+  if(formatDetectedMs != detectedBefore) {
+    printf("  (detected after %.1f ms, switching took %.3f ms, each poll %.3f ms)\n",
+           formatDetectedMs - from / 1e6, formatSwitchUs / 1e3, formatPollUs / 1e3);
+  } else {
+    printf("  (no preset change, each poll %.3f ms)\n", formatPollUs / 1e3);
+  }
+  reportBackground(backgroundBefore, simNow() - from);
+}
+
+
+static bool readPowerUpValues(const char* fileName) {
+  // a .set file, one value per line
+  FILE* file = fopen(fileName, "r");
+  if(!file) {
+    fprintf(stderr, "gbsSimulator: could not open %s\n", fileName);
+    return false;
+  }
+  
+  int count = 0;
+  char line[32];
+  while(fgets(line, sizeof(line), file)) {
+    char* end;
+    long value = strtol(line, &end, 0);
+    if(end == line) {
+      continue; // blank line
+    }
+    if(value < 0 || value > 255 || count == (int)sizeof(powerUpValues)) {
+      count = -1;
+      break;
+    }
+    powerUpValues[count++] = (uint8_t)value;
+  }
+  fclose(file);
+  
+  if(count != (int)sizeof(powerUpValues)) {
+    fprintf(stderr, "gbsSimulator: %s does not hold %d register values\n", fileName, (int)sizeof(powerUpValues));
+    return false;
+  }
+  return true;
+}
+
+
+static void loadEeprom() {
+  FILE* file = fopen(eepromFile, "rb");
+  if(file) {
+    if(fread(simEeprom(), 1, 512, file) != 512) {
+      fprintf(stderr, "gbsSimulator: %s is not a 512 byte EEPROM image, starting erased\n", eepromFile);
+      memset(simEeprom(), 0xff, 512);
+    }
+    fclose(file);
+  }
+}
+
+static void saveEeprom() {
+  FILE* file = fopen(eepromFile, "wb");
+  if(!file || fwrite(simEeprom(), 1, 512, file) != 512) {
+    fprintf(stderr, "gbsSimulator: could not write %s\n", eepromFile);
+  }
+  if(file) {
+    fclose(file);
+  }
+}
+
+
+static SimTime realTime() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (SimTime)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void passTransmitted() {
+  uint8_t sent[256];
+  int count;
+  while((count = simUartTransmitted(sent, sizeof(sent))) > 0) {
+    fwrite(sent, 1, count, stdout);
+  }
+  fflush(stdout);
+}
+
+static int runConsole() {
+  // keeps the simulated time with the real time, passing stdin to the UART and what it sends to stdout
+  setup();
+  SimTime offset = realTime() - simNow();
+  
+  for(;;) {
+    struct pollfd input = { 0, POLLIN, 0 };
+    if(poll(&input, 1, 1) > 0) {
+      uint8_t received[256];
+      ssize_t count = read(0, received, sizeof(received));
+      if(count <= 0) {
+        break; // the host is done
+      }
+      simUartReceive(received, (int)count);
+    }
+    
+    runSketch(realTime() - offset);
+    passTransmitted();
+  }
+  
+  // let the sketch answer what it got last
+  runSketch(simNow() + SIM_CONSOLE_DRAIN);
+  passTransmitted();
+  
+  if(simUartOverruns() > 0) {
+    fprintf(stderr, "gbsSimulator: %u received bytes were overwritten before they were read\n", simUartOverruns());
+  }
+  return 0;
+}
+
+
+int main(int argc, char** argv) {
+  SimGbsScaler gbs(GBS_I2C_ADDRESS);
+  scaler = &gbs;
+  
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      gbs.stretchTime = atol(argv[++i]) * 1000LL;
+    } else if(strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+      gbs.busyUntil = atol(argv[++i]) * 1000LL;
+    } else if(strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+      gbs.dropEvery = atol(argv[++i]);
+    } else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      if(!readPowerUpValues(argv[++i])) {
+        return 1;
+      }
+      gbs.powerUpValues = powerUpValues;
+    } else if(strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+      eepromFile = argv[++i];
+    } else if(strcmp(argv[i], "-r") == 0) {
+      printRegisters = true;
+    } else if(strcmp(argv[i], "-c") == 0) {
+      consoleMode = true;
+    } else {
+      fprintf(stderr, "Usage: %s [-s <stretch us>] [-b <busy us>] [-d <n>] [-p <power up set file>] [-e <EEPROM file>] [-r] [-c]\n", argv[0]);
+      return 1;
+    }
+  }
+  
+  gbs.powerUp();
+  gbs.attach();
+  simSetIrPin(true);           // the IR receiver idles high
+  simSetResolutionSwitch(false);
+  SREG = 0x80;                 // the Arduino core enables interrupts before setup()
+  
+  if(eepromFile) {
+    loadEeprom();
+  }
+  
+  if(consoleMode) {
+#if !REGISTER_CONSOLE
+    fprintf(stderr, "%s: built without the register console, add -DREGISTER_CONSOLE=1 to the g++ line\n", argv[0]);
+    return 1;
+#endif
+    int result = runConsole();
+    if(eepromFile) {
+      saveEeprom();
+    }
+    return result;
+  }
+  
+  printHeading();
+  
+  SimBusStats before = gbs.stats;
+  SimBusStats backgroundBefore = gbs.backgroundStats;
+  setup();
+  runSketch(simNow() + 1000000000LL);
+  report("boot", 0, before);
+  printf("  (waited %.3f ms for the scaler to ACK before the start array, %.3f ms before the program array, %d timeouts)\n",
+         bootWaitUs[BOOT_WAIT_START_ARRAY] / 1e3, bootWaitUs[BOOT_WAIT_PROGRAM_ARRAY] / 1e3, bootWaitTimeouts);
+#if FAST_BOOT
+  if(recordedBootState[0] == BOOT_STATE_NONE) {
+    printf("  (nothing recorded, booted into 480i)\n");
+  } else {
+    printf("  (booted into the recorded %s, bank %d)\n", recordedBootState[0] == SNAPSHOT_BASE_480I ? "480i" : "240p", recordedBootState[1]);
+  }
+#endif
+  reportBackground(backgroundBefore, simNow());
+  
+  press("CH+ (240p)", BUTTON_CH_PLUS);
+  press("CH- (480i)", BUTTON_CH_MINUS);
+  press("PREV (shift left)", BUTTON_PREV);
+  press("NEXT (shift right)", BUTTON_NEXT);
+  press("VOL- (scale smaller)", BUTTON_VOL_MINUS);
+  press("VOL+ (scale larger)", BUTTON_VOL_PLUS);
+  press("PLAY/PAUSE (shift up)", BUTTON_PLAY_PAUSE);
+  press("EQ (shift down)", BUTTON_EQ);
+  
+  uint8_t held = BUTTON_NEXT;
+  remoteAction("NEXT held 2 s", &held, 1, 18);
+  
+  uint8_t save[] = { BUTTON_200_PLUS, BUTTON_1 };
+  remoteAction("200+ 1 (save bank 1)", save, 2, 0);
+  press("CH+ (240p, adjusted)", BUTTON_CH_PLUS);
+  press("1 (load bank 1)", BUTTON_1);
+  press("CH (defaults)", BUTTON_CH);
+  
+  changeInput("input 240p", SIM_INPUT_240P);
+  changeInput("input 480i", SIM_INPUT_480I);
+  changeInput("input 240p again", SIM_INPUT_240P);
+  changeInput("input 480p (no preset)", SIM_INPUT_480P);
+  changeInput("no input", SIM_INPUT_NONE);
+  
+#if FAST_BOOT
+  press("1 (load bank 1, kept)", BUTTON_1);
+  runSketch(simNow() + BOOT_STATE_SAVE_MS * 1000000LL);
+  printf("  (recorded for the next boot: %s, bank %d)\n", recordedBootState[0] == SNAPSHOT_BASE_480I ? "480i" : "240p", recordedBootState[1]);
+#endif
+  
+  if(eepromFile) {
+    saveEeprom();
+  }
+  
+  if(printRegisters) {
+    for(int segment = 0; segment < SIM_GBS_SEGMENTS; segment++) {
+      printf("\nsegment %d\n", segment);
+      for(int reg = 0; reg < SIM_GBS_SEGMENT_SIZE; reg++) {
+        printf("%02x%s", gbs.registers[segment][reg], (reg % 16 == 15) ? "\n" : " ");
+      }
+    }
+  }
+  
+  return 0;
+}
@@ -0,0 +1,37 @@
+// Host simulation stand-in for the Arduino core (see ../SimHardware.h)
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define HIGH 1
+#define LOW  0
+#define INPUT  0
+#define OUTPUT 1
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+
+// I2CBitBanger spins on its queue, let the simulated timer run meanwhile
+#define I2CBB_WAIT_HOOK() simWait()
+
+// ...and so does RegisterConsole on the UART
+#define CONSOLE_WAIT_HOOK() simWait()
+
+#endif
@@ -0,0 +1,16 @@
+// Host simulation stand-in for the Arduino EEPROM library (512 bytes, see ../SimHardware.h)
+#ifndef SimEEPROM_h
+#define SimEEPROM_h
+
+#include <stdint.h>
+
+class EEPROMClass {
+  public:
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    void update(int address, uint8_t value);
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
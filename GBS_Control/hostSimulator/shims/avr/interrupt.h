@@ -0,0 +1,16 @@
+// Host simulation stand-in for avr/interrupt.h (see ../../SimHardware.h)
+#ifndef SimAvrInterrupt_h
+#define SimAvrInterrupt_h
+
+#include <avr/io.h>
+
+#define TIMER1_COMPA_vect SIM_TIMER1_COMPA_VECTOR
+#define PCINT0_vect       SIM_PCINT0_VECTOR
+#define LIN_TC_vect       SIM_LIN_TC_VECTOR
+
+#define ISR(vector) extern "C" void vector(void)
+
+#define cli() (SREG &= (uint8_t)~0x80)
+#define sei() (SREG |= (uint8_t)0x80)
+
+#endif
@@ -0,0 +1,45 @@
+// Host simulation stand-in for the ATtiny167 registers GBS_Control uses (see ../../SimHardware.h)
+#ifndef SimAvrIo_h
+#define SimAvrIo_h
+
+#include "../../SimHardware.h"
+
+#define _BV(bit) (1 << (bit))
+
+// TCCR1B
+#define CS10  0
+#define CS11  1
+#define CS12  2
+#define WGM12 3
+#define WGM13 4
+// TIMSK1, TIFR1
+#define TOIE1  0
+#define OCIE1A 1
+#define OCIE1B 2
+#define TOV1   0
+#define OCF1A  1
+#define OCF1B  2
+// PCICR
+#define PCIE0 0
+#define PCIE1 1
+// LINCR
+#define LCMD0  0
+#define LCMD1  1
+#define LCMD2  2
+#define LENA   3
+#define LSWRES 7
+// LINSIR
+#define LRXOK  0
+#define LTXOK  1
+#define LIDOK  2
+#define LERR   3
+#define LBUSY  4
+// LINENIR
+#define LENRXOK 0
+#define LENTXOK 1
+#define LENIDOK 2
+#define LENERR  3
+// LINBTR
+#define LDISR  7
+
+#endif
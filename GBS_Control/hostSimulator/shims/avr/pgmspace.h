@@ -0,0 +1,14 @@
+// Host simulation stand-in for avr/pgmspace.h: flash is ordinary memory on the host
+#ifndef SimAvrPgmspace_h
+#define SimAvrPgmspace_h
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(address))  // also used for pointers, which are wider than a word on the host
+#define memcpy_P(destination, source, length) memcpy((destination), (source), (length))
+
+#endif
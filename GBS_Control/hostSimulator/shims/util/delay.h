@@ -0,0 +1,15 @@
+// Host simulation stand-in for util/delay.h: delays move the simulated time on
+#ifndef SimUtilDelay_h
+#define SimUtilDelay_h
+
+#include "../../SimHardware.h"
+
+inline void _delay_us(double us) {
+  simAdvance((SimTime)(us * 1000.0 + 0.5));
+}
+
+inline void _delay_ms(double ms) {
+  simAdvance((SimTime)(ms * 1000000.0 + 0.5));
+}
+
+#endif
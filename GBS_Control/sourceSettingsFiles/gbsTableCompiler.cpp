@@ -0,0 +1,1160 @@
+/*
+  Host side table compiler for GBS_Control
+
+  Turns the register tables used by GBS_Control into PROGMEM headers
+  that can be programmed into the GBS 8200/8220 with fewer I2C transactions.
+  The inputs are checked (value ranges, segment and register counts) and an estimate of
+  the time GBS_Control takes to send each output over I2C is printed to stderr, using the
+  timing profile selected in ../I2CBitBangerTiming.h.
+
+  Build (on the host, not the Digispark):
+    g++ -O2 -o gbsTableCompiler gbsTableCompiler.cpp
+
+  Usage:
+    gbsTableCompiler set <set file> [<array name>] [-c]
+
+      Converts one of dooklink's .set files (one decimal register value per line,
+      256 lines for each of the 6 segments) into a program array header.  The array is
+      named programArray<name of the set file with '.' replaced by '_'> unless a name is given.
+      -c  print it compressed for PresetStream instead (the same as the presets command)
+
+    gbsTableCompiler bursts <input> <array name> [-n <pairs>] [-m <max burst>] [-d]
+
+      Reads a start array ((register, value) pairs, register 0xF0 selects a segment)
+      and groups runs of consecutive registers within the same segment into
+      auto-increment burst writes.  The result is printed to stdout as:
+
+        count, first register, value, value, ... (repeated), 0
+
+      -n <pairs>      only use the first <pairs> pairs of the input
+      -m <max burst>  maximum number of values in one burst (default 255, the largest count a burst header can hold)
+      -d              also leave out writes of the value a register already holds from an earlier write
+                      (only use this if no register in the input relies on being written twice)
+
+      Segment selects of the segment that is already selected are always left out.
+
+    gbsTableCompiler deltas <name>=<program array> <name>=<program array> [...]
+
+      Reads two or more program arrays (6 segments of 256 registers, registers 0x00 - 0xEF
+      of each segment are programmed) and prints, for every ordered pair of them, a burst array
+      named presetDelta<from>To<to> that only writes the registers that differ.
+      Unchanged gaps of up to 3 registers are written as part of a burst since that is cheaper
+      than starting a new transaction.
+
+    gbsTableCompiler presets <name>=<program array> <name>=<program array> [...]
+
+      Compresses program arrays for PresetStream (see ../PresetStream.h) and prints them as
+      arrays named programArray<name>.  Only registers 0x00 - 0xEF of each segment are kept.
+      Each preset is either compressed on its own or, if that is smaller, as a list of differences
+      from an earlier preset that was compressed on its own (its base).  The encoding is
+      chosen for the fewest bytes, and every preset is decompressed again and checked before it is printed.
+      Each preset is followed by programArray<name>Crcs, the CRC of every segment's registers for the
+      readback verification in ../GBS_Control.ino (registers 0x00 - 0x2F of segment 0 are read only status
+      registers and left out).
+
+    gbsTableCompiler boot <start array> [-n <pairs>] -p <power up values> <name>=<program array> [...]
+
+      Prints what FAST_BOOT in ../GBS_Control.ino writes after the start array (or its first <pairs> pairs,
+      which is sent unchanged) instead of a whole program array: for every program array a burst array named
+      bootImage<name> that programs registers 0x00 - 0xEF of each segment, leaving out every register that
+      already holds its value after power up and the start array.  <power up values> are the registers of
+      a scaler that has just been powered up, like a program array (6 segments of 256 registers), captured
+      from the board with gbsConsole's save command.  Unchanged gaps of up to 3 registers are written as
+      part of a burst like in the deltas.
+
+    gbsTableCompiler capture <capture file> [-a <address>]
+
+      Reads a bus capture streamed out by ../I2CSniffer.h (e.g. the GBS 8220's own microcontroller
+      programming a preset), replays the writes to the scaler (7 bit I2C address, 0x17 unless given)
+      and prints the resulting registers as a .set file for the set command.  Registers that were
+      never written are printed as 0 and counted on stderr, as are reads, NACKs and any data the
+      sniffer lost.
+
+  Input files may either be a C header (the values between the first '{' and the last '}' are used,
+  comments are ignored) or a .set file (one number per line, a trailing comma is allowed).
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL  // Digispark Pro
+#endif
+#include "../I2CBitBangerTiming.h"
+
+#define SEGMENT_SELECT_REGISTER 0xF0
+#define DEFAULT_MAX_BURST 255
+#define NUM_SEGMENTS 6
+#define SEGMENT_SIZE 256
+#define PROGRAMMED_REGISTERS_PER_SEGMENT 240
+#define MAX_BRIDGE_GAP 3
+#define UNKNOWN_SEGMENT -1
+
+// PresetStream tokens: the top 2 bits are the kind, the low 6 bits are the run length - 1
+#define PRESET_TOKEN_LITERAL 0x00  // followed by the values
+#define PRESET_TOKEN_ZEROS   0x40
+#define PRESET_TOKEN_REPEAT  0x80  // followed by the value
+#define PRESET_TOKEN_BASE    0xC0  // the values are the base preset's
+#define PRESET_MAX_RUN       64
+#define PRESET_NO_BASE       0xFF
+
+// readback verification CRCs (must match PROGRAM_VERIFY in ../GBS_Control.ino)
+#define VERIFY_STATUS_REGISTERS 0x30  // segment 0 registers 0x00 - 0x2F can't be read back
+#define VERIFY_CRC_INITIAL 0xFFFF
+
+// I2CSniffer stream escapes (see ../I2CSniffer.h)
+#define SNIFF_ESCAPE   0xFE
+#define SNIFF_LITERAL  0x00
+#define SNIFF_START    0x01
+#define SNIFF_STOP     0x02
+#define SNIFF_NACK     0x03
+#define SNIFF_OVERFLOW 0x04
+#define GBS_I2C_ADDRESS 0x17
+
+struct Burst {
+  uint8_t firstRegister;
+  std::vector<uint8_t> values;
+};
+
+
+static bool parseNumber(const std::string& text, size_t* position, const char* fileName, int line, std::vector<uint8_t>& output) {
+  const char* start = text.c_str() + *position;
+  char* end = NULL;
+  long value = strtol(start, &end, 0);
+
+  if(end == start || (*end != '\0' && (isalnum((unsigned char)*end) || *end == '.' || *end == '-'))) {
+    std::cerr << fileName << ":" << line << ": not a number" << std::endl;
+    return false;
+  }
+
+  if(value < 0 || value > 255) {
+    std::cerr << fileName << ":" << line << ": value " << value << " does not fit in a byte" << std::endl;
+    return false;
+  }
+
+  output.push_back((uint8_t)value);
+  *position = end - text.c_str();
+  return true;
+}
+
+
+static bool readHeaderNumbers(const std::string& text, const char* fileName, std::vector<uint8_t>& output) {
+  // the numbers between the first '{' and the last '}', skipping comments
+  size_t open = text.find('{');
+  size_t close = text.rfind('}');
+  if(open == std::string::npos || close == std::string::npos || close < open) {
+    std::cerr << fileName << ": no array found" << std::endl;
+    return false;
+  }
+
+  int line = 1 + std::count(text.begin(), text.begin() + open, '\n');
+  size_t i = open + 1;
+
+  while(i < close) {
+    if(text.compare(i, 2, "//") == 0) {
+      i = text.find('\n', i);
+    } else if(text.compare(i, 2, "/*") == 0) {
+      size_t commentEnd = text.find("*/", i + 2);
+      line += std::count(text.begin() + i, text.begin() + std::min(commentEnd, close), '\n');
+      i = (commentEnd == std::string::npos) ? close : commentEnd + 2;
+    } else if(isdigit((unsigned char)text[i])) {
+      if(!parseNumber(text, &i, fileName, line, output)) {
+        return false;
+      }
+    } else if(text[i] == ',' || isspace((unsigned char)text[i])) {
+      line += (text[i] == '\n');
+      i++;
+    } else {
+      std::cerr << fileName << ":" << line << ": unexpected '" << text[i] << "'" << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+static bool readSetNumbers(const std::string& text, const char* fileName, std::vector<uint8_t>& output) {
+  // one number per line (blank lines are ignored)
+  std::istringstream lines(text);
+  std::string lineText;
+  int line = 0;
+
+  while(std::getline(lines, lineText)) {
+    line++;
+
+    size_t i = lineText.find_first_not_of(" \t\r");
+    if(i == std::string::npos) {
+      continue;
+    }
+
+    if(!parseNumber(lineText, &i, fileName, line, output)) {
+      return false;
+    }
+
+    if(lineText.find_first_not_of(" \t\r,", i) != std::string::npos) {
+      std::cerr << fileName << ":" << line << ": expected one number per line" << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+static bool readNumberList(const char* fileName, std::vector<uint8_t>& output) {
+  std::ifstream file(fileName);
+  if(!file) {
+    std::cerr << "could not open " << fileName << std::endl;
+    return false;
+  }
+
+  std::stringstream contents;
+  contents << file.rdbuf();
+  std::string text = contents.str();
+
+  if(text.find('{') != std::string::npos) {
+    return readHeaderNumbers(text, fileName, output);
+  }
+  return readSetNumbers(text, fileName, output);
+}
+
+
+static bool readProgramArray(const char* fileName, std::vector<uint8_t>& program) {
+  if(!readNumberList(fileName, program)) {
+    return false;
+  }
+
+  if(program.size() != NUM_SEGMENTS*SEGMENT_SIZE) {
+    std::cerr << fileName << ": expected " << NUM_SEGMENTS*SEGMENT_SIZE << " values (" << NUM_SEGMENTS << " segments of "
+              << SEGMENT_SIZE << " registers), found " << program.size();
+    if(program.size() % SEGMENT_SIZE == 0) {
+      std::cerr << " (" << program.size() / SEGMENT_SIZE << " segments)";
+    }
+    std::cerr << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+
+static bool checkStartArray(const std::vector<uint8_t>& pairs, size_t numPairs, const char* fileName) {
+  // segment selects must select a segment that exists, other registers must be below the select register
+  bool segmentSelected = false;
+
+  for(size_t i = 0; i < numPairs; i++) {
+    uint8_t reg = pairs[i*2];
+    uint8_t value = pairs[i*2 + 1];
+
+    if(reg == SEGMENT_SELECT_REGISTER) {
+      if(value >= NUM_SEGMENTS) {
+        std::cerr << fileName << ": pair " << i << " selects segment " << (unsigned)value << ", there are only " << NUM_SEGMENTS << std::endl;
+        return false;
+      }
+      segmentSelected = true;
+    } else if(reg > SEGMENT_SELECT_REGISTER) {
+      std::cerr << fileName << ": pair " << i << " writes register " << (unsigned)reg << ", above the segment select register" << std::endl;
+      return false;
+    } else if(!segmentSelected) {
+      std::cerr << fileName << ": warning: pair " << i << " is written before any segment is selected" << std::endl;
+      segmentSelected = true;  // only warn once
+    }
+  }
+
+  return true;
+}
+
+
+static std::vector<uint8_t> removeRedundantWrites(const std::vector<uint8_t>& pairs, size_t numPairs, bool removeRepeatedValues) {
+  // leaves out segment selects of the selected segment and (optionally) writes of a value a register already holds
+  std::vector<uint8_t> output;
+  int segment = UNKNOWN_SEGMENT;
+  std::vector<int> lastValue(NUM_SEGMENTS*SEGMENT_SIZE, -1);
+
+  for(size_t i = 0; i < numPairs; i++) {
+    uint8_t reg = pairs[i*2];
+    uint8_t value = pairs[i*2 + 1];
+
+    if(reg == SEGMENT_SELECT_REGISTER) {
+      if(segment == value) {
+        continue;
+      }
+      segment = value;
+    } else if(segment != UNKNOWN_SEGMENT) {
+      int& last = lastValue[segment*SEGMENT_SIZE + reg];
+      if(removeRepeatedValues && last == value) {
+        continue;
+      }
+      last = value;
+    }
+
+    output.push_back(reg);
+    output.push_back(value);
+  }
+
+  return output;
+}
+
+
+// Estimated I2C time, from the phases I2CBitBanger waits for (the time spent between phases is not counted)
+static double byteMicroseconds() {
+  return 8*(I2CBBActiveTiming::dataSetup + I2CBBActiveTiming::clockHigh + I2CBBActiveTiming::clockLow) +
+         I2CBBActiveTiming::dataSetup + I2CBBActiveTiming::clockHigh + I2CBBActiveTiming::ackHold;
+}
+
+static double writeMicroseconds(size_t numTransactions, size_t numValues) {
+  // each register write transaction sends a start, the slave address, the first register, the values and a stop
+  double transactionOverhead = I2CBBActiveTiming::startHold + I2CBBActiveTiming::startToData +
+                               I2CBBActiveTiming::stopLow + I2CBBActiveTiming::stopSetup + I2CBBActiveTiming::busFree +
+                               2*byteMicroseconds();
+  return numTransactions*transactionOverhead + numValues*byteMicroseconds();
+}
+
+static void printEstimate(const char* format, size_t flashBytes, size_t numTransactions, size_t numValues) {
+  fprintf(stderr, "  %-26s %6u bytes of flash %5u transactions %8.1f ms\n", format, (unsigned)flashBytes,
+          (unsigned)numTransactions, writeMicroseconds(numTransactions, numValues) / 1000.0);
+}
+
+static void printBurstEstimate(const char* format, const std::vector<Burst>& bursts) {
+  size_t flashBytes = 1;  // terminator
+  size_t numValues = 0;
+  for(size_t i = 0; i < bursts.size(); i++) {
+    flashBytes += 2 + bursts[i].values.size();
+    numValues += bursts[i].values.size();
+  }
+  printEstimate(format, flashBytes, bursts.size(), numValues);
+}
+
+
+static std::vector<Burst> groupIntoBursts(const std::vector<uint8_t>& pairs, size_t numPairs, size_t maxBurst) {
+  std::vector<Burst> bursts;
+
+  for(size_t i = 0; i < numPairs; i++) {
+    uint8_t reg = pairs[i*2];
+    uint8_t value = pairs[i*2 + 1];
+
+    // Only append to the previous burst if this register directly follows it.
+    // Segment selects always stand alone so a run never crosses a segment boundary.
+    if(!bursts.empty() && reg != SEGMENT_SELECT_REGISTER) {
+      Burst& last = bursts.back();
+      if(last.firstRegister != SEGMENT_SELECT_REGISTER &&
+         last.firstRegister + last.values.size() == reg &&
+         last.values.size() < maxBurst) {
+        last.values.push_back(value);
+        continue;
+      }
+    }
+
+    Burst burst;
+    burst.firstRegister = reg;
+    burst.values.push_back(value);
+    bursts.push_back(burst);
+  }
+
+  return bursts;
+}
+
+
+static void printBurstArray(const std::vector<Burst>& bursts, const char* arrayName) {
+  printf("const uint8_t %s[] PROGMEM = {\n", arrayName);
+  printf("// count, first register, values...\n");
+
+  for(size_t i = 0; i < bursts.size(); i++) {
+    printf("%u, %u,", (unsigned)bursts[i].values.size(), (unsigned)bursts[i].firstRegister);
+    for(size_t j = 0; j < bursts[i].values.size(); j++) {
+      printf(" %u,", (unsigned)bursts[i].values[j]);
+    }
+    printf("\n");
+  }
+
+  printf("0\n};\n");
+}
+
+
+static void printBurstHeader(const std::vector<Burst>& bursts, const char* inputName, const char* arrayName, size_t numPairs) {
+  printf("// Generated by sourceSettingsFiles/gbsTableCompiler from %s (do not edit by hand)\n", inputName);
+  printf("// %u register writes grouped into %u burst writes\n\n", (unsigned)numPairs, (unsigned)bursts.size());
+  printBurstArray(bursts, arrayName);
+}
+
+
+static int compileBursts(int argc, char** argv) {
+  if(argc < 4) {
+    return -1;
+  }
+
+  const char* inputName = argv[2];
+  const char* arrayName = argv[3];
+  long numPairs = -1;
+  long maxBurst = DEFAULT_MAX_BURST;
+  bool removeRepeatedValues = false;
+
+  for(int i = 4; i < argc; i++) {
+    if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      numPairs = strtol(argv[++i], NULL, 0);
+    } else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+      maxBurst = strtol(argv[++i], NULL, 0);
+    } else if(strcmp(argv[i], "-d") == 0) {
+      removeRepeatedValues = true;
+    } else {
+      return -1;
+    }
+  }
+
+  if(maxBurst < 1 || maxBurst > 255) {
+    std::cerr << "max burst must be between 1 and 255" << std::endl;
+    return 1;
+  }
+
+  std::vector<uint8_t> pairs;
+  if(!readNumberList(inputName, pairs)) {
+    return 1;
+  }
+
+  if(pairs.size() % 2 != 0) {
+    std::cerr << inputName << ": odd number of values, expected (register, value) pairs" << std::endl;
+    return 1;
+  }
+
+  if(numPairs < 0) {
+    numPairs = pairs.size() / 2;
+  } else if((size_t)numPairs > pairs.size() / 2) {
+    std::cerr << inputName << ": only " << pairs.size() / 2 << " pairs available" << std::endl;
+    return 1;
+  }
+
+  if(!checkStartArray(pairs, numPairs, inputName)) {
+    return 1;
+  }
+
+  std::vector<uint8_t> writes = removeRedundantWrites(pairs, numPairs, removeRepeatedValues);
+  std::vector<Burst> bursts = groupIntoBursts(writes, writes.size() / 2, maxBurst);
+  printBurstHeader(bursts, inputName, arrayName, writes.size() / 2);
+
+  fprintf(stderr, "%s (estimated I2C time):\n", inputName);
+  printEstimate("one write per pair", numPairs*2, numPairs, numPairs);
+  printBurstEstimate("burst writes", bursts);
+
+  return 0;
+}
+
+
+static std::vector<Burst> diffPrograms(const std::vector<uint8_t>& from, const std::vector<uint8_t>& to) {
+  std::vector<Burst> bursts;
+
+  for(int segment = 0; segment < NUM_SEGMENTS; segment++) {
+    bool segmentSelected = false;
+    int lastDifference = -1;
+
+    for(int reg = 0; reg < PROGRAMMED_REGISTERS_PER_SEGMENT; reg++) {
+      int index = segment*SEGMENT_SIZE + reg;
+      if(from[index] == to[index]) {
+        continue;
+      }
+
+      if(!segmentSelected) {
+        Burst select;
+        select.firstRegister = SEGMENT_SELECT_REGISTER;
+        select.values.push_back((uint8_t)segment);
+        bursts.push_back(select);
+        segmentSelected = true;
+      }
+
+      Burst& last = bursts.back();
+      if(lastDifference >= 0 && reg - lastDifference - 1 <= MAX_BRIDGE_GAP &&
+         last.values.size() + (reg - lastDifference) <= DEFAULT_MAX_BURST) {
+        // extend the current burst through the (unchanged) gap
+        for(int gap = lastDifference + 1; gap <= reg; gap++) {
+          last.values.push_back(to[segment*SEGMENT_SIZE + gap]);
+        }
+      } else {
+        Burst burst;
+        burst.firstRegister = (uint8_t)reg;
+        burst.values.push_back(to[index]);
+        bursts.push_back(burst);
+      }
+
+      lastDifference = reg;
+    }
+  }
+
+  return bursts;
+}
+
+
+static std::vector<Burst> changingBursts(const std::vector<uint8_t>& pairs, std::vector<uint8_t>& registers) {
+  // Groups the writes of pairs ((register, value), register 0xF0 selects a segment, the first pair must select one)
+  // that change a register into bursts, bridging unchanged gaps like diffPrograms.  registers holds the value of
+  // every register before the writes and is updated with them.  The bursts start with a segment select.
+  std::vector<Burst> bursts;
+  int segment = UNKNOWN_SEGMENT;        // selected by the bursts so far
+  int writeSegment = UNKNOWN_SEGMENT;   // selected by the pairs so far
+
+  for(size_t i = 0; i + 1 < pairs.size(); i += 2) {
+    uint8_t reg = pairs[i];
+    uint8_t value = pairs[i + 1];
+
+    if(reg == SEGMENT_SELECT_REGISTER) {
+      writeSegment = value;
+      continue;
+    }
+
+    uint8_t& current = registers[writeSegment*SEGMENT_SIZE + reg];
+    if(current == value) {
+      continue;
+    }
+    current = value;
+
+    if(writeSegment != segment) {
+      Burst select;
+      select.firstRegister = SEGMENT_SELECT_REGISTER;
+      select.values.push_back((uint8_t)writeSegment);
+      bursts.push_back(select);
+      segment = writeSegment;
+    }
+
+    Burst& last = bursts.back();
+    int next = last.firstRegister + (int)last.values.size();  // the register after the last burst
+    if(last.firstRegister != SEGMENT_SELECT_REGISTER && reg >= next && reg - next <= MAX_BRIDGE_GAP &&
+       last.values.size() + (reg - next) + 1 <= DEFAULT_MAX_BURST) {
+      // extend the last burst through the (unchanged) gap
+      for(int gap = next; gap < reg; gap++) {
+        last.values.push_back(registers[segment*SEGMENT_SIZE + gap]);
+      }
+      last.values.push_back(value);
+    } else {
+      Burst burst;
+      burst.firstRegister = reg;
+      burst.values.push_back(value);
+      bursts.push_back(burst);
+    }
+  }
+
+  return bursts;
+}
+
+
+static int compileBootImages(int argc, char** argv) {
+  if(argc < 4) {
+    return -1;
+  }
+
+  const char* startArrayName = argv[2];
+  const char* powerUpName = NULL;
+  long numPairs = -1;
+  std::vector<std::string> names;
+  std::vector< std::vector<uint8_t> > programs;
+
+  for(int i = 3; i < argc; i++) {
+    const char* separator = strchr(argv[i], '=');
+    if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      numPairs = strtol(argv[++i], NULL, 0);
+    } else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      powerUpName = argv[++i];
+    } else if(separator != NULL && separator != argv[i]) {
+      std::vector<uint8_t> program;
+      if(!readProgramArray(separator + 1, program)) {
+        return 1;
+      }
+      names.push_back(std::string(argv[i], separator - argv[i]));
+      programs.push_back(program);
+    } else {
+      return -1;
+    }
+  }
+
+  if(programs.empty()) {
+    return -1;
+  }
+
+  if(powerUpName == NULL) {
+    std::cerr << "the power up values (-p) are needed, save them from a board that has just been powered up" << std::endl;
+    return 1;
+  }
+
+  std::vector<uint8_t> pairs;
+  if(!readNumberList(startArrayName, pairs)) {
+    return 1;
+  }
+
+  if(pairs.size() % 2 != 0) {
+    std::cerr << startArrayName << ": odd number of values, expected (register, value) pairs" << std::endl;
+    return 1;
+  }
+
+  if(numPairs < 0) {
+    numPairs = pairs.size() / 2;
+  } else if((size_t)numPairs > pairs.size() / 2) {
+    std::cerr << startArrayName << ": only " << pairs.size() / 2 << " pairs available" << std::endl;
+    return 1;
+  }
+  pairs.resize(numPairs*2);
+
+  if(!checkStartArray(pairs, numPairs, startArrayName)) {
+    return 1;
+  }
+
+  std::vector<uint8_t> afterStart;
+  if(!readProgramArray(powerUpName, afterStart)) {
+    return 1;
+  }
+
+  // the start array is sent as it is, so every one of its writes lands
+  int segment = UNKNOWN_SEGMENT;
+  for(long i = 0; i < numPairs; i++) {
+    uint8_t reg = pairs[i*2];
+    uint8_t value = pairs[i*2 + 1];
+    if(reg == SEGMENT_SELECT_REGISTER) {
+      segment = value;
+    } else if(segment == UNKNOWN_SEGMENT) {
+      std::cerr << startArrayName << ": pair " << i << " is written before any segment is selected, its register is unknown" << std::endl;
+      return 1;
+    } else {
+      afterStart[segment*SEGMENT_SIZE + reg] = value;
+    }
+  }
+
+  printf("// Generated by sourceSettingsFiles/gbsTableCompiler from %s (first %ld pairs) and %s (do not edit by hand)\n",
+         startArrayName, numPairs, powerUpName);
+  printf("// The program arrays without the registers that hold their value after power up and the start array\n");
+
+  fprintf(stderr, "boot images (estimated I2C time):\n");
+  printEstimate("whole program array", NUM_SEGMENTS*SEGMENT_SIZE, NUM_SEGMENTS*2, NUM_SEGMENTS*(1 + PROGRAMMED_REGISTERS_PER_SEGMENT));
+
+  for(size_t p = 0; p < programs.size(); p++) {
+    std::vector<uint8_t> programPairs;
+    for(int segment = 0; segment < NUM_SEGMENTS; segment++) {
+      programPairs.push_back(SEGMENT_SELECT_REGISTER);
+      programPairs.push_back((uint8_t)segment);
+      for(int reg = 0; reg < PROGRAMMED_REGISTERS_PER_SEGMENT; reg++) {
+        programPairs.push_back((uint8_t)reg);
+        programPairs.push_back(programs[p][segment*SEGMENT_SIZE + reg]);
+      }
+    }
+
+    std::vector<uint8_t> registers = afterStart;
+    std::vector<Burst> bursts = changingBursts(programPairs, registers);
+    std::string arrayName = "bootImage" + names[p];
+    printf("\n");
+    printBurstArray(bursts, arrayName.c_str());
+    printBurstEstimate(arrayName.c_str(), bursts);
+  }
+
+  return 0;
+}
+
+
+static int compileDeltas(int argc, char** argv) {
+  if(argc < 4) {
+    return -1;
+  }
+
+  std::vector<std::string> names;
+  std::vector< std::vector<uint8_t> > programs;
+
+  for(int i = 2; i < argc; i++) {
+    const char* separator = strchr(argv[i], '=');
+    if(separator == NULL || separator == argv[i]) {
+      return -1;
+    }
+
+    std::vector<uint8_t> program;
+    if(!readProgramArray(separator + 1, program)) {
+      return 1;
+    }
+
+    names.push_back(std::string(argv[i], separator - argv[i]));
+    programs.push_back(program);
+  }
+
+  printf("// Generated by sourceSettingsFiles/gbsTableCompiler (do not edit by hand)\n");
+  printf("// Burst arrays that switch the scaler from one program array to another\n");
+  fprintf(stderr, "preset deltas (estimated I2C time):\n");
+  printEstimate("whole program array", NUM_SEGMENTS*SEGMENT_SIZE, NUM_SEGMENTS*2, NUM_SEGMENTS*(1 + PROGRAMMED_REGISTERS_PER_SEGMENT));
+
+  for(size_t from = 0; from < programs.size(); from++) {
+    for(size_t to = 0; to < programs.size(); to++) {
+      if(from == to) {
+        continue;
+      }
+
+      std::vector<Burst> bursts = diffPrograms(programs[from], programs[to]);
+      std::string arrayName = "presetDelta" + names[from] + "To" + names[to];
+      printf("\n");
+      printBurstArray(bursts, arrayName.c_str());
+      printBurstEstimate(arrayName.c_str(), bursts);
+    }
+  }
+
+  return 0;
+}
+
+
+static std::vector<uint8_t> programmedRegisters(const std::vector<uint8_t>& program) {
+  std::vector<uint8_t> registers;
+  for(int segment = 0; segment < NUM_SEGMENTS; segment++) {
+    registers.insert(registers.end(), program.begin() + segment*SEGMENT_SIZE,
+                     program.begin() + segment*SEGMENT_SIZE + PROGRAMMED_REGISTERS_PER_SEGMENT);
+  }
+  return registers;
+}
+
+
+static std::vector<uint8_t> compressPreset(const std::vector<uint8_t>& registers, const std::vector<uint8_t>* base) {
+  // Finds the shortest token stream with dynamic programming: cost[i] is the fewest bytes that encode registers i..end
+  size_t n = registers.size();
+  std::vector<size_t> cost(n + 1, 0);
+  std::vector<uint8_t> bestKind(n, 0);
+  std::vector<size_t> bestRun(n, 0);
+
+  for(size_t i = n; i-- > 0;) {
+    cost[i] = (size_t)-1;
+
+    for(size_t run = 1; run <= PRESET_MAX_RUN && i + run <= n; run++) {
+      size_t last = i + run - 1;
+      bool allZero = true, allSame = true, allBase = (base != NULL);
+      for(size_t j = i; j <= last; j++) {
+        allZero = allZero && registers[j] == 0;
+        allSame = allSame && registers[j] == registers[i];
+        allBase = allBase && registers[j] == (*base)[j];
+      }
+
+      const uint8_t kinds[] = { PRESET_TOKEN_LITERAL, PRESET_TOKEN_ZEROS, PRESET_TOKEN_REPEAT, PRESET_TOKEN_BASE };
+      const bool usable[] = { true, allZero, allSame, allBase };
+      const size_t sizes[] = { 1 + run, 1, 2, 1 };
+
+      for(int k = 0; k < 4; k++) {
+        if(usable[k] && sizes[k] + cost[i + run] < cost[i]) {
+          cost[i] = sizes[k] + cost[i + run];
+          bestKind[i] = kinds[k];
+          bestRun[i] = run;
+        }
+      }
+    }
+  }
+
+  std::vector<uint8_t> stream;
+  for(size_t i = 0; i < n; i += bestRun[i]) {
+    stream.push_back(bestKind[i] | (uint8_t)(bestRun[i] - 1));
+    if(bestKind[i] == PRESET_TOKEN_LITERAL) {
+      stream.insert(stream.end(), registers.begin() + i, registers.begin() + i + bestRun[i]);
+    } else if(bestKind[i] == PRESET_TOKEN_REPEAT) {
+      stream.push_back(registers[i]);
+    }
+  }
+
+  return stream;
+}
+
+
+static std::vector<uint8_t> decompressPreset(const std::vector<uint8_t>& stream, const std::vector<uint8_t>* base, size_t numRegisters) {
+  // the same decoding as PresetStream, used to check the compressor's output
+  std::vector<uint8_t> registers;
+  size_t pos = 0;
+
+  while(registers.size() < numRegisters && pos < stream.size()) {
+    uint8_t token = stream[pos++];
+    size_t run = (token & 0x3F) + 1;
+    uint8_t repeatValue = 0;
+    if((token & 0xC0) == PRESET_TOKEN_REPEAT && pos < stream.size()) {
+      repeatValue = stream[pos++];
+    }
+
+    for(size_t j = 0; j < run; j++) {
+      switch(token & 0xC0) {
+        case PRESET_TOKEN_LITERAL: registers.push_back(pos < stream.size() ? stream[pos++] : 0); break;
+        case PRESET_TOKEN_ZEROS:   registers.push_back(0); break;
+        case PRESET_TOKEN_REPEAT:  registers.push_back(repeatValue); break;
+        default:                   registers.push_back(base != NULL && registers.size() < base->size() ? (*base)[registers.size()] : 0); break;
+      }
+    }
+  }
+
+  return registers;
+}
+
+
+static uint16_t crcCcittUpdate(uint16_t crc, uint8_t data) {
+  // the same as _crc_ccitt_update of avr-libc's util/crc16.h
+  data ^= (uint8_t)crc;
+  data ^= (uint8_t)(data << 4);
+  return (uint16_t)((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+
+
+static void printSegmentCrcs(const std::string& name, const std::vector<uint8_t>& registers) {
+  printf("const uint16_t programArray%sCrcs[%d] PROGMEM = {", name.c_str(), NUM_SEGMENTS);
+  for(int segment = 0; segment < NUM_SEGMENTS; segment++) {
+    uint16_t crc = VERIFY_CRC_INITIAL;
+    for(int reg = (segment == 0) ? VERIFY_STATUS_REGISTERS : 0; reg < PROGRAMMED_REGISTERS_PER_SEGMENT; reg++) {
+      crc = crcCcittUpdate(crc, registers[segment*PROGRAMMED_REGISTERS_PER_SEGMENT + reg]);
+    }
+    printf("%s 0x%04X", segment == 0 ? "" : ",", crc);
+  }
+  printf(" };\n");
+}
+
+
+static int printCompressedPresets(const std::vector<std::string>& names, const std::vector< std::vector<uint8_t> >& registers) {
+  std::vector< std::vector<uint8_t> > streams;
+  std::vector<size_t> baseOf;          // index of each preset's base (PRESET_NO_BASE if none)
+  std::vector<size_t> baseTableIndex;  // position of each preset in presetStreamBases (PRESET_NO_BASE if not a base)
+  size_t numBases = 0;
+  size_t totalBytes = 0;
+
+  for(size_t p = 0; p < registers.size(); p++) {
+    std::vector<uint8_t> best = compressPreset(registers[p], NULL);
+    size_t bestBase = PRESET_NO_BASE;
+
+    // only presets that stand on their own can be a base, so decoding never needs more than one
+    for(size_t b = 0; b < p; b++) {
+      if(baseOf[b] != PRESET_NO_BASE) {
+        continue;
+      }
+      std::vector<uint8_t> candidate = compressPreset(registers[p], &registers[b]);
+      if(candidate.size() < best.size()) {
+        best = candidate;
+        bestBase = b;
+      }
+    }
+
+    const std::vector<uint8_t>* base = (bestBase == PRESET_NO_BASE) ? NULL : &registers[bestBase];
+    if(decompressPreset(best, base, registers[p].size()) != registers[p]) {
+      std::cerr << names[p] << ": compressed preset does not decompress to the original" << std::endl;
+      return 1;
+    }
+
+    streams.push_back(best);
+    baseOf.push_back(bestBase);
+    baseTableIndex.push_back(PRESET_NO_BASE);
+    totalBytes += best.size() + 1;
+  }
+
+  for(size_t p = 0; p < streams.size(); p++) {
+    if(baseOf[p] != PRESET_NO_BASE && baseTableIndex[baseOf[p]] == PRESET_NO_BASE) {
+      baseTableIndex[baseOf[p]] = numBases++;
+    }
+  }
+
+  printf("// Generated by sourceSettingsFiles/gbsTableCompiler (do not edit by hand)\n");
+  printf("// Compressed program arrays, decompressed on the fly by PresetStream\n");
+  printf("// %u presets of %u registers in %u bytes\n", (unsigned)streams.size(), (unsigned)registers[0].size(), (unsigned)totalBytes);
+
+  for(size_t p = 0; p < streams.size(); p++) {
+    printf("\n// %s: %u bytes", names[p].c_str(), (unsigned)streams[p].size() + 1);
+    if(baseOf[p] != PRESET_NO_BASE) {
+      printf(", differences from %s", names[baseOf[p]].c_str());
+    }
+    printf("\nconst uint8_t programArray%s[] PROGMEM = {\n", names[p].c_str());
+    printf("%u, // base\n", baseOf[p] == PRESET_NO_BASE ? 0 : (unsigned)baseTableIndex[baseOf[p]] + 1);
+
+    // one token (and its values) per line
+    size_t pos = 0;
+    while(pos < streams[p].size()) {
+      uint8_t token = streams[p][pos];
+      size_t tokenBytes = 1;
+      if((token & 0xC0) == PRESET_TOKEN_LITERAL) {
+        tokenBytes += (token & 0x3F) + 1;
+      } else if((token & 0xC0) == PRESET_TOKEN_REPEAT) {
+        tokenBytes += 1;
+      }
+      for(size_t j = 0; j < tokenBytes; j++) {
+        printf("%s%u,", j == 0 ? "" : " ", (unsigned)streams[p][pos + j]);
+      }
+      printf("\n");
+      pos += tokenBytes;
+    }
+    printf("};\n");
+    printSegmentCrcs(names[p], registers[p]);
+  }
+
+  printf("\nconst uint8_t* const presetStreamBases[] PROGMEM = {");
+  for(size_t i = 0; i < numBases; i++) {
+    for(size_t p = 0; p < streams.size(); p++) {
+      if(baseTableIndex[p] == i) {
+        printf("%s programArray%s", i == 0 ? "" : ",", names[p].c_str());
+      }
+    }
+  }
+  printf(numBases == 0 ? " NULL };\n" : " };\n");
+
+  // decompressing doesn't change what is sent, so the I2C time is the same as for an uncompressed program array
+  fprintf(stderr, "presets (estimated I2C time for each):\n");
+  printEstimate("program array", NUM_SEGMENTS*SEGMENT_SIZE, NUM_SEGMENTS*2, NUM_SEGMENTS*(1 + PROGRAMMED_REGISTERS_PER_SEGMENT));
+  for(size_t p = 0; p < streams.size(); p++) {
+    std::string format = "compressed " + names[p];
+    printEstimate(format.c_str(), streams[p].size() + 1, NUM_SEGMENTS*2, NUM_SEGMENTS*(1 + PROGRAMMED_REGISTERS_PER_SEGMENT));
+  }
+
+  return 0;
+}
+
+
+static int compilePresets(int argc, char** argv) {
+  if(argc < 3) {
+    return -1;
+  }
+
+  std::vector<std::string> names;
+  std::vector< std::vector<uint8_t> > registers;
+
+  for(int i = 2; i < argc; i++) {
+    const char* separator = strchr(argv[i], '=');
+    if(separator == NULL || separator == argv[i]) {
+      return -1;
+    }
+
+    std::vector<uint8_t> program;
+    if(!readProgramArray(separator + 1, program)) {
+      return 1;
+    }
+
+    names.push_back(std::string(argv[i], separator - argv[i]));
+    registers.push_back(programmedRegisters(program));
+  }
+
+  return printCompressedPresets(names, registers);
+}
+
+
+static int compileSetFile(int argc, char** argv) {
+  if(argc < 3) {
+    return -1;
+  }
+
+  const char* inputName = argv[2];
+  std::string name;
+  bool compress = false;
+
+  for(int i = 3; i < argc; i++) {
+    if(strcmp(argv[i], "-c") == 0) {
+      compress = true;
+    } else if(name.empty() && argv[i][0] != '-') {
+      name = argv[i];
+    } else {
+      return -1;
+    }
+  }
+
+  if(name.empty()) {
+    // the set file's name with periods replaced by underscores
+    name = inputName;
+    size_t slash = name.rfind('/');
+    if(slash != std::string::npos) {
+      name = name.substr(slash + 1);
+    }
+    std::replace(name.begin(), name.end(), '.', '_');
+  }
+
+  std::vector<uint8_t> program;
+  if(!readProgramArray(inputName, program)) {
+    return 1;
+  }
+
+  if(compress) {
+    return printCompressedPresets(std::vector<std::string>(1, name), std::vector< std::vector<uint8_t> >(1, programmedRegisters(program)));
+  }
+
+  printf("// Generated by sourceSettingsFiles/gbsTableCompiler from %s (do not edit by hand)\n\n", inputName);
+  printf("const uint8_t programArray%s[] PROGMEM = {\n", name.c_str());
+  for(int segment = 0; segment < NUM_SEGMENTS; segment++) {
+    for(int row = 0; row < SEGMENT_SIZE / 16; row++) {
+      for(int column = 0; column < 16; column++) {
+        size_t index = segment*SEGMENT_SIZE + row*16 + column;
+        printf("%u%s", (unsigned)program[index], index + 1 < program.size() ? (column == 15 ? ",\n" : ", ") : "\n");
+      }
+    }
+  }
+  printf("};\n");
+
+  fprintf(stderr, "%s (estimated I2C time):\n", inputName);
+  printEstimate("program array", NUM_SEGMENTS*SEGMENT_SIZE, NUM_SEGMENTS*2, NUM_SEGMENTS*(1 + PROGRAMMED_REGISTERS_PER_SEGMENT));
+
+  return 0;
+}
+
+
+static int compileCapture(int argc, char** argv) {
+  if(argc < 3) {
+    return -1;
+  }
+
+  const char* inputName = argv[2];
+  int address = GBS_I2C_ADDRESS;
+
+  for(int i = 3; i < argc; i++) {
+    if(strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+      address = strtol(argv[++i], NULL, 0);
+    } else {
+      return -1;
+    }
+  }
+
+  std::ifstream input(inputName, std::ios::binary);
+  if(!input) {
+    std::cerr << inputName << ": can't read it" << std::endl;
+    return 1;
+  }
+  std::vector<uint8_t> capture((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+  std::vector<uint8_t> registers(NUM_SEGMENTS*SEGMENT_SIZE, 0);
+  std::vector<bool> written(NUM_SEGMENTS*SEGMENT_SIZE, false);
+  int segment = UNKNOWN_SEGMENT;
+  int byteIndex = -1;          // byte of the current transaction, -1 outside of one
+  bool ours = false;           // the transaction is addressed to the scaler
+  bool reading = false;
+  int pointer = 0;             // the scaler's register pointer
+  int pendingIndex = -1;       // register written by the last byte (undone if it was NACKed)
+  uint8_t pendingOld = 0;
+  bool pendingWasWritten = false;
+  int pendingSegment = UNKNOWN_SEGMENT;
+  unsigned transactions = 0, writes = 0, reads = 0, nacks = 0, overflows = 0, beforeSelect = 0;
+
+  for(size_t i = 0; i < capture.size(); i++) {
+    int event = -1;
+    uint8_t value = capture[i];
+
+    if(value == SNIFF_ESCAPE) {
+      if(++i == capture.size()) {
+        break;
+      }
+      if(capture[i] != SNIFF_LITERAL) {
+        event = capture[i];
+      }
+    }
+
+    if(event == SNIFF_NACK) {
+      nacks++;
+      if(pendingIndex >= 0) {
+        // the scaler didn't take the write
+        registers[pendingIndex] = pendingOld;
+        written[pendingIndex] = pendingWasWritten;
+        segment = pendingSegment;
+        writes--;
+      }
+      pendingIndex = -1;
+      ours = false;
+      continue;
+    }
+
+    pendingIndex = -1;
+
+    if(event == SNIFF_START) {
+      byteIndex = 0;
+      continue;
+    } else if(event == SNIFF_STOP) {
+      byteIndex = -1;
+      continue;
+    } else if(event == SNIFF_OVERFLOW) {
+      overflows++;
+      continue;
+    } else if(event >= 0) {
+      std::cerr << inputName << ": unknown escape " << event << " at byte " << i << std::endl;
+      return 1;
+    }
+
+    if(byteIndex < 0) {
+      continue; // lost the START
+    }
+
+    if(byteIndex == 0) {
+      ours = (value >> 1) == address;
+      reading = (value & 0x01) != 0;
+      transactions += ours;
+    } else if(ours && reading) {
+      reads++;
+      pointer = (pointer + 1) & 0xFF;
+    } else if(ours && byteIndex == 1) {
+      pointer = value;
+    } else if(ours) {
+      if(pointer == SEGMENT_SELECT_REGISTER) {
+        pendingSegment = segment;
+        segment = (value < NUM_SEGMENTS) ? value : UNKNOWN_SEGMENT;
+      } else if(segment == UNKNOWN_SEGMENT) {
+        beforeSelect++;
+      } else {
+        pendingIndex = segment*SEGMENT_SIZE + pointer;
+        pendingOld = registers[pendingIndex];
+        pendingWasWritten = written[pendingIndex];
+        pendingSegment = segment;
+        registers[pendingIndex] = value;
+        written[pendingIndex] = true;
+      }
+      writes++;
+      pointer = (pointer + 1) & 0xFF;
+    }
+
+    byteIndex++;
+  }
+
+  unsigned neverWritten = 0;
+  for(int seg = 0; seg < NUM_SEGMENTS; seg++) {
+    for(int reg = 0; reg < PROGRAMMED_REGISTERS_PER_SEGMENT; reg++) {
+      neverWritten += !written[seg*SEGMENT_SIZE + reg];
+    }
+  }
+
+  for(size_t i = 0; i < registers.size(); i++) {
+    printf("%u\n", (unsigned)registers[i]);
+  }
+
+  fprintf(stderr, "%s: %u transactions to 0x%02x, %u bytes written, %u read, %u NACKs\n",
+          inputName, transactions, address, writes, reads, nacks);
+  if(neverWritten > 0) {
+    fprintf(stderr, "%s: warning: %u of the programmed registers (0x00 - 0xEF) were never written, they are 0\n", inputName, neverWritten);
+  }
+  if(beforeSelect > 0) {
+    fprintf(stderr, "%s: warning: %u bytes were written before the first segment select and ignored\n", inputName, beforeSelect);
+  }
+  if(overflows > 0) {
+    fprintf(stderr, "%s: warning: the sniffer lost data %u times, the capture is incomplete\n", inputName, overflows);
+  }
+
+  return 0;
+}
+
+
+static void printUsage(const char* programName) {
+  std::cerr << "Usage: " << programName << " set <set file> [<array name>] [-c]" << std::endl;
+  std::cerr << "       " << programName << " bursts <input> <array name> [-n <pairs>] [-m <max burst>] [-d]" << std::endl;
+  std::cerr << "       " << programName << " deltas <name>=<program array> <name>=<program array> [...]" << std::endl;
+  std::cerr << "       " << programName << " presets <name>=<program array> [...]" << std::endl;
+  std::cerr << "       " << programName << " boot <start array> [-n <pairs>] -p <power up values> <name>=<program array> [...]" << std::endl;
+  std::cerr << "       " << programName << " capture <capture file> [-a <address>]" << std::endl;
+}
+
+
+int main(int argc, char** argv) {
+  int result = -1;
+
+  if(argc >= 2 && strcmp(argv[1], "set") == 0) {
+    result = compileSetFile(argc, argv);
+  } else if(argc >= 2 && strcmp(argv[1], "bursts") == 0) {
+    result = compileBursts(argc, argv);
+  } else if(argc >= 2 && strcmp(argv[1], "deltas") == 0) {
+    result = compileDeltas(argc, argv);
+  } else if(argc >= 2 && strcmp(argv[1], "presets") == 0) {
+    result = compilePresets(argc, argv);
+  } else if(argc >= 2 && strcmp(argv[1], "boot") == 0) {
+    result = compileBootImages(argc, argv);
+  } else if(argc >= 2 && strcmp(argv[1], "capture") == 0) {
+    result = compileCapture(argc, argv);
+  }
+
+  if(result < 0) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  return result;
+}